@@ -2,6 +2,7 @@
 /// <reference path="mq_plugin.d.ts" />
 import { createForm } from "mqwidget"
 import { Vector3, Matrix4 } from "geom"
+import { contentHash, cacheGet, cacheSet, cacheClear } from "csg"
 import { CSGObject, CSGPrimitive, toCSGPolygons, csgToObject } from "./modules/csg.js"
 import { PrimitiveModeler } from "./modules/primitives.js"
 
@@ -30,12 +31,16 @@ const TYPE_INV = 'INV';
 const CSG_TYPES = [TYPE_UNION, TYPE_SUB, TYPE_AND, TYPE_INV];
 
 const SETTING_KEY_PREFIX = 'CSG_OBJCT_';
+// Part of the cache keys. Change this when the built meshes change.
+const CACHE_VERSION = '1';
 
 class MeshBuilder {
     constructor(slices = 32) {
         this.slices = slices;
         /**@type {Record<string, CSGObject>} */
         this.csgObj = {};
+        /**@type {Record<string, string>} */
+        this.keys = {};
         this.buildStartTime = 0;
         this.primitives = {
             CUBE: (p) => CSGPrimitive.cube(p),
@@ -70,9 +75,17 @@ class MeshBuilder {
      * @param {MQObject} obj 
      */
     buildCsg(obj) {
-        let d = mqdocument.getPluginData(SETTING_KEY_PREFIX + obj.id);
-        let spec = (d && d != "") ? JSON.parse(d) : {};
+        let spec = this.getSpec(obj);
         this.log("building... " + spec.type + " " + obj.name);
+        // Results are cached across runs, so only the nodes on the path from
+        // an edited node to the root are rebuilt.
+        let key = this.nodeKey(obj);
+        let cached = key && cacheGet(key);
+        if (cached) {
+            this.csgObj[obj.name] = CSGObject.fromMesh(cached);
+            this.log("cached " + obj.name);
+            return;
+        }
         if (spec.type == TYPE_PRIMITIVE) {
             this.csgObj[obj.name] = this.buildPrimitive(spec.primitive, obj)?.transformed(new Matrix4(obj.globalMatrix));
         } else if (spec.type == TYPE_OBJREF) {
@@ -88,8 +101,49 @@ class MeshBuilder {
         } else {
             this.csgObj[obj.name] = new CSGObject(toCSGPolygons(obj));
         }
+        if (key && this.csgObj[obj.name]) {
+            cacheSet(key, this.csgObj[obj.name].toMesh());
+        }
         this.log("built " + obj.name);
     }
+    /**
+     * @param {MQObject} obj 
+     */
+    getSpec(obj) {
+        let d = mqdocument.getPluginData(SETTING_KEY_PREFIX + obj.id);
+        return (d && d != "") ? JSON.parse(d) : {};
+    }
+    /**
+     * Hash of the spec, the transform and the source geometry of the node and its descendants.
+     * @param {MQObject} obj 
+     * @returns {string} null if the result of the node can not be cached.
+     */
+    nodeKey(obj) {
+        if (obj.name in this.keys) {
+            return this.keys[obj.name];
+        }
+        this.keys[obj.name] = null; // circular references are not cached.
+        let spec = this.getSpec(obj);
+        let header = [CACHE_VERSION, JSON.stringify(CSGObject.BSP_OPTIONS), JSON.stringify(spec), obj.id, new Matrix4(obj.globalMatrix).m];
+        let key = null;
+        if (spec.type == TYPE_PRIMITIVE) {
+            key = contentHash(...header, this.slices);
+        } else if (spec.type == TYPE_OBJREF) {
+            let target = mqdocument.getObjectByName(spec.objref.name);
+            let targetKey = target && this.nodeKey(target);
+            key = targetKey && contentHash(...header, targetKey);
+        } else if (spec.type == TYPE_CSG) {
+            let keys = obj.getChildren().map(c => this.nodeKey(c));
+            key = keys.includes(null) ? null : contentHash(...header, ...keys);
+        } else if (spec.type == TYPE_IGNORE) {
+            key = contentHash(...header);
+        } else if (spec.type != TYPE_EVAL) {
+            let { counts, indices, materials } = obj.faces.toIndexArrays();
+            key = contentHash(...header, obj.verts.toFloat64Array(), counts, indices, materials);
+        }
+        this.keys[obj.name] = key;
+        return key;
+    }
     buildPrimitive(spec, obj) {
         let f = this.primitives[spec.type];
         if (!f) {
@@ -520,6 +574,7 @@ class NodeObjectWindow {
             formSpec.items.push({ type: "hframe", items: [{ id: "preview", type: "checkbox", label: "Preview", value: this.previewPrimitive, onchange: () => this.updatePreview() }] });
         }
         formSpec.items.push({ type: "button", value: "Build Mesh", onclick: (v) => { new MeshBuilder().build(obj); } });
+        formSpec.items.push({ type: "button", value: "Clear cache", onclick: (v) => { cacheClear(); } });
         formSpec.items.push({
             type: "button", value: "Hide children", onclick: (v) => {
                 obj.visible = true;
@@ -0,0 +1,36 @@
+import { Matrix4, Vector3, Plane } from "geom"
+import * as geometry from "geometry"
+
+const count = 1000000, repeat = 10;
+let positions = new Float64Array(count * 3);
+for (let i = 0; i < positions.length; i++) {
+    positions[i] = Math.random() * 200 - 100;
+}
+let out = new Float64Array(positions.length);
+let m = Matrix4.rotateMatrix(0.6, 0, 0.8, 30).mul(Matrix4.translateMatrix(1, 2, 3));
+let plane = new Plane(new Vector3(0.3, 0.5, -0.8).unit(), 1.5);
+
+function bench(name, f) {
+    let startTime = Date.now();
+    for (let i = 0; i < repeat; i++) {
+        f();
+    }
+    console.log(name + ": " + ((Date.now() - startTime) / repeat) + "ms");
+}
+
+bench("applyTo", () => {
+    for (let i = 0; i < positions.length; i += 3) {
+        let p = m.applyTo(new Vector3(positions[i], positions[i + 1], positions[i + 2]));
+        out[i] = p.x; out[i + 1] = p.y; out[i + 2] = p.z;
+    }
+});
+
+let maxLevel = geometry.simdLevel();
+for (let level of ["scalar", "sse2", "avx2"]) {
+    if (geometry.simdLevel(level) != level) {
+        break;
+    }
+    bench("transformPoints(" + level + ")", () => m.applyToArray(positions, out));
+    bench("signedDistances(" + level + ")", () => plane.signedDistances(positions));
+}
+geometry.simdLevel(maxLevel);
@@ -1,7 +1,8 @@
 // @ts-check
 /// <reference path="../mq_plugin.d.ts" />
-import { BSPTree } from "bsptree"
+import * as nativeCsg from "csg"
 import { Vector3, Plane } from "geom"
+import { weldVertices } from "geometry"
 import { PrimitiveModeler } from "./primitives.js"
 
 class Polygon {
@@ -28,6 +29,7 @@ class Polygon {
 
 class CSGObject {
 	static EPSILON = 1e-6;
+	static BSP_OPTIONS = { epsilon: CSGObject.EPSILON, heuristic: "sample", samples: 8, threads: 0 };
 	/**
 	 * @param {Polygon[]} polygons 
 	 */
@@ -44,45 +46,19 @@ class CSGObject {
 	 * @param {CSGObject} csg 
 	 */
 	union(csg) {
-		let a = new BSPTree(this.polygons);
-		let b = new BSPTree(csg.polygons);
-		let ap = this.bsp_clipPolygons(b, this.polygons);
-		let bp = this.bsp_clipPolygons(a, csg.polygons);
-		bp.forEach(function (p) { p.flip() });
-		bp = this.bsp_clipPolygons(a, bp);
-		bp.forEach(function (p) { p.flip() });
-		return new CSGObject(ap.concat(bp));
+		return CSGObject.fromNative(nativeCsg.union(this.polygons, csg.polygons, CSGObject.BSP_OPTIONS));
 	}
 	/**
 	 * @param {CSGObject} csg 
 	 */
 	subtract(csg) {
-		let a = new BSPTree(this.polygons);
-		let b = new BSPTree(csg.polygons);
-		let ap = this.clone().polygons, bp = csg.polygons;
-		ap.forEach(function (p) { p.flip() });
-		ap = this.bsp_clipPolygons(b, ap);
-		bp = this.bsp_clipPolygons(a, bp, true);
-		ap.forEach(function (p) { p.flip() });
-		bp.forEach(function (p) { p.flip() });
-		bp = this.bsp_clipPolygons(a, bp, true);
-		return new CSGObject(ap.concat(bp));
+		return CSGObject.fromNative(nativeCsg.subtract(this.polygons, csg.polygons, CSGObject.BSP_OPTIONS));
 	}
 	/**
 	 * @param {CSGObject} csg 
 	 */
 	intersect(csg) {
-		let a = new BSPTree(this.polygons);
-		let b = new BSPTree(csg.polygons);
-		let ap = this.clone().polygons, bp = csg.polygons;
-		ap.forEach(function (p) { p.flip() });
-		bp = this.bsp_clipPolygons(a, bp, true);
-		bp.forEach(function (p) { p.flip() });
-		ap = this.bsp_clipPolygons(b, ap, true);
-		bp = this.bsp_clipPolygons(a, bp, true);
-		ap = ap.concat(bp);
-		ap.forEach(function (p) { p.flip() });
-		return new CSGObject(ap);
+		return CSGObject.fromNative(nativeCsg.intersect(this.polygons, csg.polygons, CSGObject.BSP_OPTIONS));
 	}
 	inverse() {
 		let csg = this.clone();
@@ -97,8 +73,60 @@ class CSGObject {
 		}));
 	}
 
-	bsp_clipPolygons(bsp, polygons, inv = false) {
-		return bsp.clipPolygons(polygons, inv, CSGObject.EPSILON).map(p => p.src ? new Polygon(p.vertices.map(v => new Vector3(v)), p.src.shared, p.src.plane) : p.clone())
+	static fromNative(polygons) {
+		return new CSGObject(polygons.map(p => new Polygon(p.vertices.map(v => new Vector3(v)), p.src.shared, new Plane(new Vector3(p.plane.normal), p.plane.w))));
+	}
+
+	/**
+	 * Polygons and their source faces in typed arrays for csg.cacheSet.
+	 * faces and objects are the ids of shared, or -1 if the polygon has no shared.
+	 */
+	toMesh() {
+		let polygons = this.polygons;
+		let offsets = new Uint32Array(polygons.length + 1);
+		polygons.forEach((p, i) => offsets[i + 1] = offsets[i] + p.vertices.length);
+		let positions = new Float64Array(offsets[polygons.length] * 3);
+		let planes = new Float64Array(polygons.length * 4);
+		let materials = new Int32Array(polygons.length);
+		let faces = new Int32Array(polygons.length).fill(-1);
+		let objects = new Int32Array(polygons.length).fill(-1);
+		polygons.forEach((p, i) => {
+			p.vertices.forEach((v, k) => positions.set([v.x, v.y, v.z], (offsets[i] + k) * 3));
+			planes.set([p.plane.normal.x, p.plane.normal.y, p.plane.normal.z, p.plane.w], i * 4);
+			if (p.shared) {
+				materials[i] = p.shared[0].material || 0;
+				faces[i] = p.shared[0].id;
+				objects[i] = p.shared[1].id;
+			}
+		});
+		return { positions, offsets, planes, materials, faces, objects };
+	}
+
+	/**
+	 * Restores the polygons of toMesh. shared of the polygons only have the ids and the material.
+	 */
+	static fromMesh(mesh) {
+		let { positions, offsets, planes, materials, faces, objects } = mesh;
+		let shareds = new Map();
+		let polygons = [];
+		for (let i = 0; i + 1 < offsets.length; i++) {
+			let shared = null;
+			if (faces[i] >= 0) {
+				let k = objects[i] + "," + faces[i];
+				shared = shareds.get(k);
+				if (!shared) {
+					shared = [{ id: faces[i], material: materials[i] }, { id: objects[i] }];
+					shareds.set(k, shared);
+				}
+			}
+			let vertices = [];
+			for (let k = offsets[i]; k < offsets[i + 1]; k++) {
+				vertices.push(new Vector3(positions[k * 3], positions[k * 3 + 1], positions[k * 3 + 2]));
+			}
+			let plane = new Plane(new Vector3(planes[i * 4], planes[i * 4 + 1], planes[i * 4 + 2]), planes[i * 4 + 3]);
+			polygons.push(new Polygon(vertices, shared, plane));
+		}
+		return new CSGObject(polygons);
 	}
 }
 
@@ -148,217 +176,52 @@ class CSGPrimitive {
 	}
 }
 
-let epsilon = 1e-10; // TODO: use CSGObject.EPSILON
-
-function collinear(v0, v1, v2) {
-	let v01 = v1.minus(v0);
-	let v02 = v2.minus(v0);
-	let d = v01.length() * v02.length() - Math.abs(v01.dot(v02));
-	return d < epsilon;
-}
-
-function overwrap(a1, a2, b1, b2) {
-	let a1a2 = a2.minus(a1);
-	let b1b2 = b2.minus(b1);
-	if (a1a2.dot(b1b2) > a1a2.length() * b1b2.length() - epsilon) {
-		let a1b1 = b1.minus(a1);
-		if (a1b1.length() < a1a2.length() - epsilon) {
-			if (a1a2.dot(a1b1) > a1a2.length() * a1b1.length() - epsilon) {
-				return true;
-			}
-		}
-		let b1a1 = a1.minus(b1);
-		if (b1a1.length() < b1b2.length() - epsilon) {
-			if (b1b2.dot(b1a1) > b1b2.length() * b1a1.length() - epsilon) {
-				return true;
-			}
-		}
-	}
-	return false;
-}
-
-
-/**
- * @param {Vector3} p 
- * @param {Vector3} a 
- * @param {Vector3} b 
- * @param {Vector3} c 
- */
-function insideTriangle(p, a, b, c) {
-	const ab = b.minus(a), bc = c.minus(b), ca = a.minus(c);
-	const c1 = ab.cross(p.minus(a)), c2 = bc.cross(p.minus(b)), c3 = ca.cross(p.minus(c));
-	return c1.dot(c2) > 0 && c2.dot(c3) > 0 && c3.dot(c1) > 0;
-}
-
-/**
- * @param {Vector3[]} vv 
- */
-function cleanEdge(vv) {
-	const threshold = CSGObject.EPSILON * CSGObject.EPSILON * 100;
-	do {
-		var update = false;
-		for (let k = 0; k < vv.length; k++) {
-			let d = (k + 1) % vv.length;
-			if (collinear(vv[k], vv[d], vv[(k + 2) % vv.length])) {
-				vv.splice(d, 1);
-				update = true;
-			}
-		}
-	} while (update);
-	do {
-		var update = false;
-		if (vv.length > 5) {
-			for (let i = 0; i < vv.length; i++) {
-				let iv0 = vv[(i + vv.length - 1) % vv.length];
-				let iv1 = vv[i];
-				let iv2 = vv[(i + 1) % vv.length];
-				for (let j = 0; j < vv.length; j++) {
-					if (i == j) {
-						continue;
-					}
-					let jv0 = vv[(j + 1) % vv.length];
-					let jv1 = vv[j];
-					let jv2 = vv[(j + vv.length - 1) % vv.length];
-					if (iv0.distanceToSqr(jv0) < threshold && iv1.distanceToSqr(jv1) < threshold && iv2.distanceToSqr(jv2) < threshold) {
-						let ok = true;
-						for (let k = i + 2; k < i + vv.length - 1; k++) {
-							if (insideTriangle(vv[k % vv.length], iv0, iv1, iv2)) {
-								ok = false;
-								break;
-							}
-						}
-						if (!ok) {
-							continue;
-						}
-						if (i < j) {
-							vv.splice(j, 1);
-							vv.splice(i, 1);
-						} else {
-							vv.splice(j, 1);
-							vv.splice(i, 1);
-						}
-						update = true;
-						i = vv.length;
-						break;
-					}
-				}
-			}
-		}
-	} while (update);
-	return vv;
-}
-
-function tryMerge(p1, p2) {
-	let vs1 = p1.vertices
-	let vs2 = p2.vertices
-	for (var i = 0; i < vs1.length; i++) {
-		let i2 = (i + 1) % vs1.length;
-		for (var j = 0; j < vs2.length; j++) {
-			let j2 = (j - 1 + vs2.length) % vs2.length;
-			if (overwrap(vs1[i], vs1[i2], vs2[j], vs2[j2])) {
-				let vv = (i2 > i) ? vs1.slice(i2).concat(vs1.slice(0, i + 1)) : vs1.slice(i2, i + 1);
-				vv = (j > j2) ? vv.concat(vs2.slice(j)).concat(vs2.slice(0, j2 + 1)) : vv.concat(vs2.slice(j, j2 + 1));
-				vv = cleanEdge(vv);
-				if (vv.length < 3) {
-					return null;
-				}
-				return new Polygon(vv, p1.shared);
-			}
-		}
-	}
-	return null;
-}
-
 /**
+ * Merges the fragments of each source face which share edges.
  * @param {Polygon[]} polygons 
  */
 function mergePolygons(polygons) {
 	/** @type {Polygon[]} */
-	var mpolygons = [];
-	var byface = new Map();
+	let mpolygons = [];
+	/** @type {Polygon[]} */
+	let grouped = [];
+	let groupIds = new Map();
+	let groups = [];
 	polygons.forEach((p) => {
 		if (!p.shared) {
 			mpolygons.push(p);
 			return;
 		}
-		var k = p.shared[1].id + "," + p.shared[0].id;
-		var a = byface.get(k) || [];
-		a.push(p);
-		byface.set(k, a);
+		let k = p.shared[1].id + "," + p.shared[0].id;
+		if (!groupIds.has(k)) {
+			groupIds.set(k, groupIds.size);
+		}
+		grouped.push(p);
+		groups.push(groupIds.get(k));
 	});
 
-	let merged = true;
-	while (merged) {
-		merged = false;
-		byface.forEach((fs) => {
-			for (var i = 0; i < fs.length; i++) {
-				if (!fs[i]) continue;
-				for (var j = i + 1; j < fs.length; j++) {
-					if (!fs[j]) continue;
-					if (fs[i].vertices.length < 3) continue;
-					var m = tryMerge(fs[i], fs[j]);
-					if (m) {
-						delete fs[j];
-						fs[i] = m;
-						merged = true;
-					}
-				}
-			}
-		});
+	let offsets = new Uint32Array(grouped.length + 1);
+	grouped.forEach((p, i) => offsets[i + 1] = offsets[i] + p.vertices.length);
+	let positions = new Float64Array(offsets[grouped.length] * 3);
+	let offset = 0;
+	grouped.forEach((p) => p.vertices.forEach((v) => {
+		positions[offset++] = v.x;
+		positions[offset++] = v.y;
+		positions[offset++] = v.z;
+	}));
+	let merged = nativeCsg.mergePolygons({ positions, offsets, groups: Uint32Array.from(groups) }, CSGObject.EPSILON * 10);
+	for (let i = 0; i < merged.sources.length; i++) {
+		let vertices = [];
+		for (let k = merged.offsets[i]; k < merged.offsets[i + 1]; k++) {
+			vertices.push(new Vector3(merged.positions[k * 3], merged.positions[k * 3 + 1], merged.positions[k * 3 + 2]));
+		}
+		let src = grouped[merged.sources[i]];
+		mpolygons.push(new Polygon(vertices, src.shared, src.plane));
 	}
-
-	byface.forEach((fs) => {
-		mpolygons = mpolygons.concat(fs);
-	});
 	console.log("merged" + polygons.length + " -> " + mpolygons.length);
 	return mpolygons;
 }
 
-function searchOrInsertVert(sorted, p, v, makeEnt, threshold) {
-	let m = 0;
-	let n = sorted.length - 1;
-	while (m <= n) {
-		let k = (n + m) >> 1;
-		let cmp = v - sorted[k][0];
-		if (cmp > threshold*3) {
-			m = k + 1;
-		} else if(cmp < -threshold*3) {
-			n = k - 1;
-		} else {
-			for (let t = 0; k + t <= n && Math.abs(sorted[k + t][0] - v) < threshold * 3; t++) {
-				if (sorted[k + t][1].distanceToSqr(p) < threshold) {
-					return k + t;
-				}
-			}
-			for (let t = 1; k - t >= m && Math.abs(sorted[k - t][0] - v) < threshold * 3; t++) {
-				if (sorted[k - t][1].distanceToSqr(p) < threshold) {
-					return k - t;
-				}
-			}
-			break;
-		}
-	}
-	let k = sorted.length - 1;
-	for (;k >= 0 && sorted[k][0] > v; k--) {
-		sorted[k + 1] =  sorted[k];
-	}
-	sorted[k + 1] = makeEnt();
-	return k + 1;
-}
-
-/**
- * @param {Vector3} pos 
- * @param {MQObject} obj 
- * @param {[number, Vector3, number][]} verts 
- * @returns 
- */
-function getVertIndex(pos, obj, verts) {
-	const threshold = CSGObject.EPSILON * CSGObject.EPSILON * 100;
-	let v = pos.x + pos.y + pos.z;
-	let n = searchOrInsertVert(verts, pos, v, () => [v, pos, obj.verts.append(pos)], threshold);
-	return verts[n][2];
-}
-
 /**
  * @param {MQObject} dst 
  * @param {CSGObject} csg 
@@ -371,10 +234,27 @@ function csgToObject(dst, csg, mergeFaces, mergeVerts) {
 		polygons = mergePolygons(polygons);
 	}
 	if (mergeVerts) {
-		let vv = [];
+		// faces have the reversed vertex order of the polygons.
+		let counts = Uint32Array.from(polygons, (p) => p.vertices.length);
+		let positions = new Float64Array(counts.reduce((a, b) => a + b, 0) * 3);
+		let offset = 0;
 		polygons.forEach((p) => {
-			let a = p.vertices.map((v) => getVertIndex(v, dst, vv));
-			dst.faces.append(a.reverse(), p.shared ? p.shared[0].material : null);
+			for (let i = p.vertices.length - 1; i >= 0; i--, offset += 3) {
+				let v = p.vertices[i];
+				positions[offset] = v.x;
+				positions[offset + 1] = v.y;
+				positions[offset + 2] = v.z;
+			}
+		});
+		let welded = weldVertices(positions, CSGObject.EPSILON * 10);
+		let vertexIndices = new Uint32Array(welded.positions.length / 3);
+		for (let i = 0; i < vertexIndices.length; i++) {
+			vertexIndices[i] = dst.verts.append(welded.positions[i * 3], welded.positions[i * 3 + 1], welded.positions[i * 3 + 2]);
+		}
+		dst.faces.appendIndexArrays({
+			counts,
+			indices: welded.indices.map((i) => vertexIndices[i]),
+			materials: Int32Array.from(polygons, (p) => p.shared ? p.shared[0].material : 0),
 		});
 	} else {
 		polygons.forEach((p) => {
@@ -389,27 +269,25 @@ function csgToObject(dst, csg, mergeFaces, mergeVerts) {
  * @returns {Polygon[]}
  */
 function toCSGPolygons(obj) {
-	return obj.faces.reduce((acc, f) => {
-		if (!f || f.points.length < 3) return acc;
-		let points = f.points.map((i) => { return obj.verts[i] });
-		if (points.length == 3) {
-			let vs = points.reverse();
-			let p = new Polygon(vs, [f, obj]);
-			if (p.plane.w == p.plane.w) {
-				acc.push(p);
-			}
-		} else {
-			let trpoints = mqdocument.triangulate(points).map((i) => { return points[i] });
-			for (let i = 0; i < trpoints.length / 3; i++) {
-				let vs = trpoints.slice(i * 3, i * 3 + 3).reverse();
-				let p = new Polygon(vs, [f, obj]);
-				if (p.plane.w == p.plane.w) {
-					acc.push(p);
-				}
-			}
+	let { indices, faces } = mqdocument.triangulateObject(obj);
+	let positions = obj.verts.toFloat64Array();
+	/** @type {Vector3[]} */
+	let vertices = [];
+	let vertex = (i) => vertices[i] || (vertices[i] = new Vector3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]));
+	let acc = [];
+	let shared = null;
+	for (let t = 0; t < faces.length; t++) {
+		// triangles of a face are consecutive.
+		if (t == 0 || faces[t] != faces[t - 1]) {
+			shared = [obj.faces[faces[t]], obj];
 		}
-		return acc;
-	}, []);
+		let vs = [vertex(indices[t * 3 + 2]), vertex(indices[t * 3 + 1]), vertex(indices[t * 3])];
+		let p = new Polygon(vs, shared);
+		if (p.plane.w == p.plane.w) {
+			acc.push(p);
+		}
+	}
+	return acc;
 }
 
 export { CSGObject, CSGPrimitive, csgToObject, toCSGPolygons };
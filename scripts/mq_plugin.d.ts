@@ -12,6 +12,11 @@ declare module "mqdocument" {
         currentMaterialIndex: number;
         compact(): void;
         triangulate(v: VecXYZ[]): number[];
+        // Triangulates all the faces at once. Without indices, the points of each face are stored in positions in order.
+        // Returns the vertex indices of the triangles.
+        triangulateFaces(positions: Float32Array | Float64Array, counts: Uint8Array | Uint32Array, indices?: Uint32Array): Uint32Array;
+        // faces[i] is the face index of the triangle i.
+        triangulateObject(obj: MQObject): { indices: Uint32Array, faces: Uint32Array };
         clearSelect(flags?: number): void;
         isVertexSelected(obj: number, index: number): boolean;
         setVertexSelected(obj: number, index: number, select: boolean): void;
@@ -47,7 +52,7 @@ declare module "mqdocument" {
         transform: MQTransform;
         wireframe: boolean; // EXPERIMENTAL
         globalMatrix: number[]; // EXPERIMENTAL
-        applyTransform(matrix: { applyTo(p: VecXYZ): void }): void; // .core.js
+        applyTransform(matrix: { m: ArrayLike<number> } | ArrayLike<number> | { applyTo(p: VecXYZ): VecXYZ } | ((p: VecXYZ) => VecXYZ)): void; // .core.js
         getChildren(recursive?: boolean): MQObject[]; // .core.js
     }
     export interface ObjectList extends Array<MQObject> {
@@ -63,12 +68,20 @@ declare module "mqdocument" {
         append(v: VecXYZ | number[] | number, y?: number, z?: number): number;
         remove(index: number): void;
         push(v: VecXYZ): number;
+        toFloat32Array(): Float32Array; // [x0, y0, z0, x1, ...]
+        toFloat64Array(): Float64Array;
+        setFromFloat32Array(positions: Float32Array): number;
+        setFromFloat64Array(positions: Float64Array): number;
     }
     export interface FaceList extends Array<MQFace> {
         append(points: number[], material: number): number;
         remove(index: number): void;
         push(face: MQFace | { points: VecXYZ[], material?: number }): number;
+        toIndexArrays(): FaceIndexArrays;
+        appendIndexArrays(faces: FaceIndexArrays): number;
     }
+    // counts[i]: number of points of the face i (0 if deleted). indices: concatenated points.
+    export type FaceIndexArrays = { counts: Uint8Array | Uint32Array, indices: Uint32Array, materials?: Int32Array };
     export type MQVertex = { readonly id: number, readonly refs: number } & Vec3;
     export interface MQFace {
         readonly id?: number;
@@ -159,16 +172,93 @@ declare module "fs" {
 declare module "bsptree" {
     // Experimental implementation of BSP tree.
     export type BSPPolygon = { vertices: VecXYZ[], plane: any, src?: BSPPolygon, [key: string]: any };
+    export type BSPBuildOptions = {
+        epsilon?: number,
+        heuristic?: "first" | "sample",
+        samples?: number,
+        threads?: number, // 0: all cores (default: 1)
+        parallelThreshold?: number,
+        // "float" builds a single precision tree (half the memory). Results are
+        // rounded to float, so use a larger epsilon. (default: "double")
+        precision?: "double" | "float",
+    };
+    // Polygon i has the vertices [offsets[i], offsets[i + 1]).
+    export type PolygonSoup = { positions: Float64Array | Float32Array, offsets: Uint32Array };
+    // sources[i]: index of the input polygon.
+    export type PolygonSoupResult = PolygonSoup & { sources: Uint32Array };
     export class BSPTree {
-        constructor(polygons: any[]);
-        build(polygons: any[], epsilon: number): void;
+        constructor(polygons: any[] | PolygonSoup, options?: number | BSPBuildOptions);
+        readonly nodeCount: number;
+        readonly depth: number;
+        readonly precision: "double" | "float";
+        build(polygons: any[] | PolygonSoup, options?: number | BSPBuildOptions): void;
         raycast(ray: { origin: VecXYZ, direction: VecXYZ }, epsilon?: number): VecXYZ | null;
+        // rays: [ox, oy, oz, dx, dy, dz, ...] => [x, y, z, t, ...] (t: -1 if not hit)
+        raycastBatch(rays: Float64Array, epsilon?: number): Float64Array;
         crassifyPoint(point: VecXYZ, epsilon: number): number;
         clipPolygons(polygons: BSPPolygon[], inv: boolean, epsilon: number): BSPPolygon[];
         splitPolygons(src: BSPPolygon[], resultI: BSPPolygon[] | null, resultO: BSPPolygon[] | null, epsilon: number): void;
+        clipPolygonSoup(polygons: PolygonSoup, inv: boolean, epsilon: number): PolygonSoupResult;
+        splitPolygonSoup(polygons: PolygonSoup, epsilon: number): { inner: PolygonSoupResult, outer: PolygonSoupResult };
     }
 }
 
+declare module "bvh" {
+    type MQObject = import("mqdocument").MQObject;
+    export type BVHHit = { position: VecXYZ, distance: number, face: number };
+    // Bounding volume hierarchy over the faces of an object (local coordinates).
+    export class BVH {
+        constructor(obj?: MQObject);
+        readonly nodeCount: number;
+        readonly triangleCount: number;
+        build(obj: MQObject): void;
+        raycast(ray: { origin: VecXYZ, direction: VecXYZ }, maxDistance?: number): BVHHit | null;
+        closestPoint(point: VecXYZ, maxDistance?: number): BVHHit | null;
+        // returns indices of the faces intersecting the triangle.
+        overlaps(triangle: VecXYZ[], epsilon?: number): number[];
+    }
+    // returns indices of the faces intersecting other faces of the object.
+    export function findSelfIntersections(obj: MQObject, epsilon?: number): Uint32Array;
+}
+
+declare module "csg" {
+    // Boolean operations on closed meshes. src of the results refers to the input polygon.
+    import { BSPPolygon, BSPBuildOptions } from "bsptree";
+    export type CSGPolygon = { vertices: VecXYZ[], plane: { normal: VecXYZ, w: number }, src: BSPPolygon };
+    export function union(a: BSPPolygon[], b: BSPPolygon[], options?: number | BSPBuildOptions): CSGPolygon[];
+    export function subtract(a: BSPPolygon[], b: BSPPolygon[], options?: number | BSPBuildOptions): CSGPolygon[];
+    export function intersect(a: BSPPolygon[], b: BSPPolygon[], options?: number | BSPBuildOptions): CSGPolygon[];
+    // Merges the polygons of the same group which share edges. Collinear vertices of the merged polygons are removed.
+    // sources[i] is the index of an input polygon merged into the polygon i.
+    export function mergePolygons<T extends Float32Array | Float64Array>(soup: { positions: T, offsets: Uint32Array, groups: Uint32Array }, epsilon?: number):
+        { positions: T, offsets: Uint32Array, sources: Uint32Array };
+    // CSG results kept by the plugin across script runs. Least recently used meshes are dropped over 256MB.
+    // planes: [nx, ny, nz, w, ...]. faces and objects: ids of the source face of each polygon, or -1.
+    export type CachedMesh = {
+        positions: Float64Array, offsets: Uint32Array, planes: Float64Array,
+        materials: Int32Array, faces: Int32Array, objects: Int32Array
+    };
+    export function contentHash(...values: (string | number | ArrayBufferView)[]): string;
+    export function cacheGet(key: string): CachedMesh | null;
+    export function cacheSet(key: string, mesh: CachedMesh): void;
+    export function cacheClear(key?: string): void;
+}
+
+declare module "geometry" {
+    // Native kernels of the geom module. positions: [x0, y0, z0, x1, ...]
+    type Matrix4Like = ArrayLike<number> | { m: ArrayLike<number> };
+    type FloatArray = Float32Array | Float64Array;
+    export function multiplyMatrix<T extends FloatArray>(a: Matrix4Like, b: Matrix4Like, out: T): T;
+    export function transformPoints<T extends FloatArray>(m: Matrix4Like, positions: T, out?: T): T;
+    export function rotatePoints<T extends FloatArray>(q: VecXYZW, positions: T, out?: T): T;
+    export function signedDistances(plane: { normal: VecXYZ, w: number }, positions: FloatArray): Float64Array;
+    // Merges vertices within epsilon (exact duplicates if 0) into the first one.
+    // indices[i] is the index of the welded vertex of the input vertex i.
+    export function weldVertices<T extends FloatArray>(positions: T | { positions: T }, epsilon?: number): { positions: T, indices: Uint32Array };
+    // Lowers the SIMD level used by the functions above. Returns the current level.
+    export function simdLevel(level?: "scalar" | "sse2" | "avx2"): string;
+}
+
 // .core.js
 declare module "geom" {
     export class Vector3 {
@@ -198,6 +288,8 @@ declare module "geom" {
         constructor(x?: number, y?: number, z?: number, w?: number);
         dot(v: VecXYZW): number;
         applyTo(v: VecXYZ): Vector3;
+        // rotates [x0, y0, z0, x1, ...]. returns out or a new array.
+        applyToArray<T extends Float32Array | Float64Array>(positions: T, out?: T): T;
         multiply(q: Quaternion): Quaternion;
         length(): number;
         clone(): Vector3;
@@ -210,6 +302,8 @@ declare module "geom" {
         constructor(mat: number[]);
         m: number[];
         applyTo(v: VecXYZ): Vector3;
+        // transforms [x0, y0, z0, x1, ...]. returns out or a new array.
+        applyToArray<T extends Float32Array | Float64Array>(positions: T, out?: T): T;
         mul(m: Matrix4): Matrix4;
         static multiply(m1: Matrix4, m2: Matrix4, result: Matrix4): Matrix4;
         static scaleMatrix(x: number, y: number, z: number): Matrix4;
@@ -223,6 +317,7 @@ declare module "geom" {
         w: number;
         distanceTo(v: Vector3): number
         flipped(): Plane;
+        signedDistances(positions: Float32Array | Float64Array): Float64Array;
         toString(): string;
         static fromPoints(a: Vector3, b: Vector3, c: Vector3): Plane;
     }
@@ -1,7 +1,13 @@
 // @ts-check
 /// <reference path="mq_plugin.d.ts" />
 import { assert, test } from "./modules/tests.js"
-import { Vector3 } from "geom"
+import { Vector3, Matrix4, Quaternion, Plane } from "geom"
+import { BSPTree } from "bsptree"
+import { BVH, findSelfIntersections } from "bvh"
+import * as geometry from "geometry"
+import * as nativeCsg from "csg"
+import { CSGObject, CSGPrimitive } from "./modules/csg.js"
+import { PrimitiveModeler } from "./modules/primitives.js"
 
 test("Core", (t) => {
 	assert.equals("object", typeof mqdocument);
@@ -13,6 +19,56 @@ test("Core", (t) => {
 	console.log(" Version: " + process.version);
 });
 
+test("geom", (t) => {
+	let m = Matrix4.translateMatrix(1, 2, 3).mul(Matrix4.scaleMatrix(2, 2, 2));
+	let p = m.applyTo(new Vector3(1, 1, 1));
+	assert.equals("3,4,5", [p.x, p.y, p.z].join(), "multiply");
+	let positions = new Float64Array([1, 1, 1, 0, 0, 0]);
+	let transformed = m.applyToArray(positions);
+	assert.assert(transformed instanceof Float64Array && transformed !== positions, "applyToArray");
+	assert.equals("3,4,5,1,2,3", transformed.join(), "applyToArray");
+	m.applyToArray(positions, positions);
+	assert.equals("3,4,5,1,2,3", positions.join(), "applyToArray in-place");
+
+	let q = Quaternion.fromAxisAngle(new Vector3(0, 0, 1), Math.PI / 2);
+	let r = q.applyTo(new Vector3(1, 0, 0));
+	let rotated = q.applyToArray(new Float32Array([1, 0, 0]));
+	assert.assert(Math.abs(rotated[0] - r.x) < 1e-6 && Math.abs(rotated[1] - r.y) < 1e-6, "Quaternion.applyToArray");
+
+	let plane = new Plane(new Vector3(0, 1, 0), 1);
+	assert.equals("-1,2", plane.signedDistances(new Float64Array([5, 0, 5, 0, 3, 0])).join(), "signedDistances");
+
+	let welded = geometry.weldVertices(new Float64Array([0, 0, 0, 1, 0, 0, 0, 0, 1e-9, 1, 1e-9, 0, 2, 0, 0]), 1e-6);
+	assert.equals("0,0,0,1,0,0,2,0,0", welded.positions.join(), "weldVertices positions");
+	assert.equals("0,1,0,1,2", welded.indices.join(), "weldVertices indices");
+	assert.equals("0,1,0,2", geometry.weldVertices(new Float32Array([1, 2, 3, 0, 0, 0, 1, 2, 3, -0, 0, 1])).indices.join(), "weldVertices exact");
+
+	// round coordinates exactly eps apart. compared with the brute force result.
+	let grid = new Float64Array(3 * 729).map((_, i) => {
+		let k = Math.floor(i / 3) * 101 % 729;
+		return [k % 9 - 4, Math.floor(k / 9) % 9 - 4, Math.floor(k / 81) - 4][i % 3] * 0.05 + (i % 3 == 1 ? 0.3 : 0);
+	});
+	let firsts = [], expect = [];
+	for (let i = 0; i < 729; i++) {
+		let d = (j) => [0, 1, 2].reduce((s, a) => { let v = grid[i * 3 + a] - grid[j * 3 + a]; return s + v * v; }, 0);
+		let w = firsts.findIndex((j) => d(j) <= 0.1 * 0.1);
+		expect.push(w < 0 ? firsts.push(i) - 1 : w);
+	}
+	assert.equals(expect.join(), geometry.weldVertices(grid, 0.1).indices.join(), "weldVertices eps apart");
+
+	// every SIMD level returns the same results.
+	let maxLevel = geometry.simdLevel();
+	let points = new Float32Array(3 * 7).map((_, i) => i * 0.7 - 5);
+	let expected = null;
+	for (let level of ["scalar", "sse2", "avx2"]) {
+		geometry.simdLevel(level);
+		let result = m.applyToArray(points).join() + ";" + plane.signedDistances(points).join();
+		assert.equals(expected || result, result, "simd " + level);
+		expected = result;
+	}
+	assert.equals(maxLevel, geometry.simdLevel(maxLevel), "simdLevel");
+});
+
 test("MQDocument", (t) => {
 	mqdocument.compact();
 	mqdocument.clearSelect();
@@ -27,6 +83,9 @@ test("MQDocument", (t) => {
 		assert.equals(3, mqdocument.triangulate([{ x: 0, y: 0, z: 0 }, { x: 0, y: 1, z: 0 }, { x: 0, y: 0, z: 1 }]).length);
 		assert.equals(6, mqdocument.triangulate([{ x: 0, y: 0, z: 0 }, { x: 0, y: 1, z: 0 }, { x: 0, y: 0, z: 1 }, { x: 1, y: 1, z: 1 }]).length);
 		assert.equals(0, mqdocument.triangulate([{ x: 0, y: 0, z: 0 }]).length);
+		let quad = new Float64Array([0, 0, 0, 0, 1, 0, 0, 0, 1, 1, 1, 1]);
+		assert.equals(9, mqdocument.triangulateFaces(quad, new Uint8Array([4, 3]), new Uint32Array([0, 1, 2, 3, 3, 2, 1])).length);
+		assert.equals("0,1,2", mqdocument.triangulateFaces(quad, new Uint32Array([3, 1])).join());
 	}
 	{
 		// select
@@ -44,6 +103,12 @@ test("MQDocument", (t) => {
 		mqdocument.setFaceSelected(idx, 0, true);
 		assert.equals(true, mqdocument.isFaceSelected(idx, 0));
 
+		obj.verts.append(1, 1, 1);
+		obj.faces.append([0, 1, 3, 2], 0);
+		let triangles = mqdocument.triangulateObject(obj);
+		assert.equals(9, triangles.indices.length, "triangulateObject");
+		assert.equals("0,1,1", triangles.faces.join(), "triangulateObject faces");
+
 		mqdocument.objects.remove(obj);
 	}
 });
@@ -82,6 +147,15 @@ test("MQObject", (t) => {
 		assert.equals(-1, obj.index, "index should be cleared.");
 		assert.equals(0, obj.id, "id should be cleared.");
 	}
+	{
+		let obj = new MQObject("transform");
+		obj.transform.position = new Vector3(1, 2, 3);
+		assert.equals(2, obj.transform.position.y, "position");
+		obj.transform.position = [4, 5, 6];
+		assert.equals(6, obj.transform.position.z, "position array");
+		obj.transform.scale = { x: 2, y: 2, z: 2 };
+		assert.equals(2, obj.transform.scale.x, "scale");
+	}
 	{
 		let idx = mqdocument.objects.append(new MQObject("test"));
 		assert.equals("test", mqdocument.objects[idx].name, "append");
@@ -120,10 +194,61 @@ test("MQObject verts/faces", (t) => {
 	// assert.equals(0, obj.verts[2].x, "0 if not a number");
 	assert.equals("number", typeof obj.verts[0].id);
 	assert.assert(obj.verts[0] instanceof Vector3);
+	assert.equals(undefined, obj.verts[3], "out of range");
+	assert.assert(2 in obj.verts && !(3 in obj.verts), "has index");
+	assert.assert("append" in obj.verts, "has method");
+	assert.equals("function", typeof obj.verts.append);
+	// @ts-ignore
+	obj.verts.tag = 1;
+	// @ts-ignore
+	assert.equals(1, obj.verts.tag, "own property");
+	let inherited = null;
+	Object.defineProperty(Object.prototype, "testSetter", { set(v) { inherited = v; }, configurable: true });
+	// @ts-ignore
+	obj.verts.testSetter = 2;
+	// @ts-ignore
+	delete Object.prototype.testSetter;
+	assert.equals(2, inherited, "inherited setter");
+	assert.assert(!Object.prototype.hasOwnProperty.call(obj.verts, "testSetter"), "inherited setter not shadowed");
+	obj.verts[2] = { x: 789, y: 2, z: 1 };
+	assert.throws(RangeError, () => { obj.verts[3] = { x: 1, y: 2, z: 3 }; }, "set out of range");
+	assert.equals(789, obj.verts[2].x, "set index");
+
+	let positions = obj.verts.toFloat64Array();
+	assert.equals(9, positions.length, "toFloat64Array");
+	assert.equals(456, positions[3], "toFloat64Array");
+	assert.equals(2, obj.verts.toFloat32Array()[5], "toFloat32Array");
+	positions[3] = 10;
+	assert.equals(3, obj.verts.setFromFloat64Array(positions), "setFromFloat64Array");
+	assert.equals(10, obj.verts[1].x, "setFromFloat64Array");
+	assert.equals(1, obj.verts.setFromFloat32Array(new Float32Array([1, 2, 3])), "setFromFloat32Array");
+	assert.equals(1, obj.verts[0].x, "setFromFloat32Array");
+	assert.equals(10, obj.verts[1].x, "setFromFloat32Array");
+	obj.verts.setFromFloat64Array(new Float64Array([123, 0, 0]));
+	obj.applyTransform(Matrix4.translateMatrix(1, 2, 3));
+	assert.equals(124, obj.verts[0].x, "applyTransform");
+	assert.equals(3, obj.verts[1].y, "applyTransform");
+	obj.applyTransform([1, 0, 0, -1, 0, 1, 0, -2, 0, 0, 1, -3, 0, 0, 0, 1]);
+	assert.equals(123, obj.verts[0].x, "applyTransform array");
+	obj.applyTransform((p) => ({ x: p.x * 2, y: p.y, z: p.z }));
+	assert.equals(246, obj.verts[0].x, "applyTransform function");
+	obj.applyTransform({ applyTo: (p) => ({ x: p.x / 2, y: p.y, z: p.z }) });
+	assert.equals(123, obj.verts[0].x, "applyTransform applyTo");
 
 	obj.faces.append([0, 1, 2], 0);
 	obj.faces.append([0, 2, 1], 0);
 	assert.equals(2, obj.faces.length);
+	let topology = obj.faces.toIndexArrays();
+	assert.assert(topology.counts instanceof Uint8Array, "counts");
+	assert.equals("3,3", topology.counts.join(), "counts");
+	assert.equals("0,1,2,0,2,1", topology.indices.join(), "indices");
+	assert.equals("0,0", topology.materials.join(), "materials");
+	assert.equals(1, obj.faces.appendIndexArrays({ counts: new Uint8Array([3]), indices: new Uint32Array([2, 1, 0]), materials: new Int32Array([1]) }), "appendIndexArrays");
+	assert.throws(RangeError, () => obj.faces.appendIndexArrays({ counts: new Uint8Array([3]), indices: new Uint32Array([0, 1, 99]) }), "index out of range");
+	assert.equals(3, obj.faces.length);
+	assert.equals(1, obj.faces[2].material);
+	assert.equals(2, obj.faces[2].points[0]);
+	delete obj.faces[2];
 	assert.equals(1, obj.faces[0].points[1]);
 	assert.equals(0, obj.faces[0].material);
 	assert.equals(2, obj.faces[1].points[1]);
@@ -207,6 +332,127 @@ test("MQScene", (t) => {
 	assert.notNull(mqdocument.scene.fov);
 });
 
+test("BSPTree", (t) => {
+	let polygons = CSGPrimitive.sphere({ radius: 1 }, 16, 8).polygons;
+	for (let options of [undefined, 1e-6, { heuristic: "first" }, { heuristic: "sample", samples: 4 }, { threads: 0, parallelThreshold: 16 }, { precision: "float" }]) {
+		let bsp = new BSPTree(polygons, options);
+		assert.assert(bsp.nodeCount > 0, "nodeCount");
+		assert.assert(bsp.depth <= bsp.nodeCount, "depth");
+		assert.equals(2, bsp.classifyPoint({ x: 0, y: 0, z: 0 }), "inner");
+		assert.equals(1, bsp.classifyPoint({ x: 2, y: 0, z: 0 }), "outer");
+	}
+	let serial = new BSPTree(polygons, { heuristic: "sample" });
+	let parallel = new BSPTree(polygons, { heuristic: "sample", threads: 4, parallelThreshold: 16 });
+	assert.equals(serial.nodeCount, parallel.nodeCount, "parallel build");
+	assert.equals(serial.depth, parallel.depth, "parallel build");
+	assert.equals("double", serial.precision, "precision");
+	assert.equals("float", new BSPTree(polygons, { precision: "float" }).precision, "precision");
+	// @ts-ignore
+	assert.throws(TypeError, () => new BSPTree(polygons, { heuristic: "samples" }), "unknown heuristic");
+});
+
+test("BSPTree polygon soup", (t) => {
+	let polygons = CSGPrimitive.sphere({ radius: 1 }, 16, 8).polygons;
+	let positions = new Float64Array(polygons.flatMap(p => p.vertices.flatMap(v => [v.x, v.y, v.z])));
+	let offsets = new Uint32Array(polygons.length + 1);
+	polygons.forEach((p, i) => offsets[i + 1] = offsets[i] + p.vertices.length);
+	let bsp = new BSPTree({ positions, offsets });
+	assert.equals(new BSPTree(polygons).nodeCount, bsp.nodeCount, "nodeCount");
+	assert.equals(2, bsp.classifyPoint({ x: 0, y: 0, z: 0 }), "inner");
+	assert.throws(TypeError, () => new BSPTree({ positions: new Float64Array(9), offsets: new Uint32Array([0, 99]) }), "invalid soup");
+	assert.throws(TypeError, () => bsp.build("hoge"), "invalid soup 2");
+
+	let cube = CSGPrimitive.cube({ size: 1 }).polygons;
+	let cubeSoup = {
+		positions: new Float32Array(cube.flatMap(p => p.vertices.flatMap(v => [v.x, v.y, v.z]))),
+		offsets: new Uint32Array(cube.map((p, i) => i * 4).concat([cube.length * 4])),
+	};
+	let inner = [], outer = [];
+	bsp.splitPolygons(cube, inner, outer, 1e-6);
+	let r = bsp.splitPolygonSoup(cubeSoup, 1e-6);
+	assert.assert(r.inner.positions instanceof Float32Array, "positions type");
+	assert.equals(inner.length, r.inner.sources.length, "inner");
+	assert.equals(outer.length, r.outer.sources.length, "outer");
+	assert.equals(r.outer.sources.length + 1, r.outer.offsets.length, "offsets");
+	assert.equals(cube.length, bsp.clipPolygonSoup(cubeSoup, true, 1e-6).sources.length, "clip");
+
+	// the first three points are collinear.
+	let collinear = { positions: new Float64Array([0, 0, 5, 1, 0, 5, 2, 0, 5, 2, 1, 5, 0, 1, 5]), offsets: new Uint32Array([0, 5]) };
+	assert.equals(1, bsp.clipPolygonSoup(collinear, false, 1e-6).sources.length, "collinear points");
+});
+
+test("BSPTree raycastBatch", (t) => {
+	let bsp = new BSPTree(CSGPrimitive.cube({ size: 2 }).polygons, { threads: 0 });
+	let hits = bsp.raycastBatch(new Float64Array([-5, 0, 0, 1, 0, 0, -5, 3, 0, 1, 0, 0]));
+	assert.throws(RangeError, () => bsp.raycastBatch(new Float64Array(7)), "length");
+	let hit = bsp.raycast({ origin: { x: -5, y: 0, z: 0 }, direction: { x: 1, y: 0, z: 0 } });
+	assert.equals(8, hits.length, "length");
+	assert.equals(hit.x, hits[0], "x");
+	assert.assert(Math.abs(hits[3] - 4) < 1e-3, "t");
+	assert.equals(-1, hits[7], "miss");
+});
+
+test("BVH", (t) => {
+	let obj = new MQObject("test");
+	new PrimitiveModeler(obj).cube({ size: 2 });
+	let bvh = new BVH(obj);
+	assert.equals(12, bvh.triangleCount, "triangleCount");
+	let hit = bvh.raycast({ origin: { x: -5, y: 0, z: 0 }, direction: { x: 1, y: 0, z: 0 } });
+	assert.equals(4, hit.distance, "raycast");
+	assert.equals(-1, hit.position.x, "raycast");
+	assert.equals(null, bvh.raycast({ origin: { x: -5, y: 3, z: 0 }, direction: { x: 1, y: 0, z: 0 } }), "raycast");
+	assert.equals(null, bvh.raycast({ origin: { x: -5, y: 0, z: 0 }, direction: { x: 1, y: 0, z: 0 } }, 3), "maxDistance");
+	let p = bvh.closestPoint({ x: 0, y: 3, z: 0 });
+	assert.equals(1, p.position.y, "closestPoint");
+	assert.equals(2, p.distance, "closestPoint");
+	assert.equals(2, bvh.overlaps([{ x: 0, y: -3, z: 0.1 }, { x: 0, y: 3, z: 0.1 }, { x: 0.1, y: 0, z: 0.2 }]).length, "overlaps");
+	assert.equals(0, findSelfIntersections(obj).length, "no self intersections");
+	let m = new PrimitiveModeler(obj);
+	m.transform = { applyTo: (v) => ({ x: v.x + 1, y: v.y + 0.5, z: v.z }) };
+	m.cube({ size: 2 });
+	assert.equals(4, findSelfIntersections(obj).length, "self intersections");
+	obj.clear();
+});
+
+test("CSG", (t) => {
+	let a = CSGPrimitive.cube({ size: 1 });
+	let b = CSGPrimitive.cube({ size: 1 }).transformed({ applyTo: (v) => v.plus(new Vector3(0.5, 0, 0)) });
+	let inside = (csg, p) => new BSPTree(csg.polygons).classifyPoint(p);
+	let u = a.union(b), s = a.subtract(b), i = a.intersect(b);
+	assert.equals(2, inside(u, { x: 0.9, y: 0, z: 0 }), "union");
+	assert.equals(1, inside(s, { x: 0.2, y: 0, z: 0 }), "subtract");
+	assert.equals(2, inside(s, { x: -0.4, y: 0, z: 0 }), "subtract");
+	assert.equals(2, inside(i, { x: 0.2, y: 0, z: 0 }), "intersect");
+	assert.equals(1, inside(i, { x: -0.4, y: 0, z: 0 }), "intersect");
+
+	let uf = nativeCsg.union(a.polygons, b.polygons, { precision: "float", epsilon: 1e-5 });
+	assert.equals(2, new BSPTree(uf).classifyPoint({ x: 0.9, y: 0, z: 0 }), "union float");
+	assert.equals(1, new BSPTree(uf).classifyPoint({ x: 1.2, y: 0, z: 0 }), "union float");
+
+	// a unit square split into a triangle and two triangles with a T-junction, and a square of another group.
+	let soup = {
+		positions: new Float64Array([0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 1, 1, 0, 0.5, 0.5, 0, 0.5, 0.5, 0, 1, 1, 0, 0, 1, 0, 5, 0, 0, 6, 0, 0, 6, 1, 0, 5, 1, 0]),
+		offsets: new Uint32Array([0, 3, 6, 9, 13]),
+		groups: new Uint32Array([0, 0, 0, 1]),
+	};
+	let merged = nativeCsg.mergePolygons(soup);
+	assert.equals("4,8", merged.offsets.join().slice(2), "mergePolygons");
+	assert.equals("0,3", merged.sources.join(), "mergePolygons sources");
+
+	let positions = new Float64Array([0, 0, 0, 1, 0, 0, 0, 1, 0]);
+	let key = nativeCsg.contentHash("test", 1, positions);
+	assert.equals(key, nativeCsg.contentHash("test", 1, positions.slice()), "contentHash");
+	assert.assert(key != nativeCsg.contentHash("test", 1, positions.subarray(3)), "contentHash");
+	let cube = CSGPrimitive.cube({ size: 1 });
+	cube.polygons.forEach((p, i) => p.shared = [{ id: i, material: 2 }, { id: 1 }]);
+	nativeCsg.cacheSet(key, cube.toMesh());
+	let restored = CSGObject.fromMesh(nativeCsg.cacheGet(key));
+	assert.equals(cube.polygons.length, restored.polygons.length, "cacheGet");
+	assert.equals(2, restored.polygons[0].shared[0].material, "cacheGet material");
+	nativeCsg.cacheClear(key);
+	assert.isNull(nativeCsg.cacheGet(key), "cacheClear");
+});
+
 test("Result", (t) => {
 	if (t.success == t.count) {
 		console.log(" ok. " + t.success + "/" + t.count + " tests passed.");
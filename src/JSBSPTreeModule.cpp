@@ -1,122 +1,105 @@
-
-
-#include < unordered_map>
+#include <unordered_map>
 #include <functional>
 #include <vector>
 
+#include "JSGeometry.h"
 #include "Utils.h"
 #include "bsptree.h"
+#include "csg.h"
+#include "parallel.h"
 #include "qjsutils.h"
 
 using namespace std;
 
-const double MIN_EPSILON = 1e-10;
-const double DEFAULT_EPSILON = 1e-6;
-typedef geom::Polygon<double, JSValue> JSPolygon;
+class JSBSPTree : public JSClassBase<JSBSPTree> {
+ public:
+  static const JSCFunctionListEntry proto_funcs[];
 
-template <>
-struct std::hash<geom::Vector3> {
-  std::size_t operator()(const geom::Vector3& v) const {
-    std::hash<double> dh;
-    std::hash<size_t> sh;
-    return sh(sh(dh(v.x)) ^ dh(v.y)) ^ dh(v.y);
+  geom::BSPNode node;
+  geom::BSPNodeF nodeF;  // used instead of node if singlePrecision.
+  bool singlePrecision = false;
+  unsigned int threads = 1;
+  JSValue Init(JSContext* ctx, JSValueConst this_obj, int argc,
+               JSValueConst* argv) {
+    if (argc > 0) {
+      return Build(ctx, argv[0], argc > 1 ? argv[1] : JS_UNDEFINED);
+    }
+    return JS_UNDEFINED;
   }
-};
-
-JSValue ToJSValue(JSContext* ctx, const geom::Vector3& v) {
-  ValueHolder obj(ctx);
-  obj.Set("x", v.x);
-  obj.Set("y", v.y);
-  obj.Set("z", v.z);
-  return unwrap(std::move(obj));
-}
 
-JSValue ToJSValue(JSContext* ctx, const JSPolygon& p,
-                  unordered_map<geom::Vector3, JSValue>& vcache) {
-  ValueHolder obj(ctx);
-  ValueHolder vertices(ctx, JS_NewArray(ctx));
-  for (uint32_t i = 0; i < p.vertices.size(); i++) {
-    auto c = vcache.find(p.vertices[i]);
-    if (c == vcache.end()) {
-      JSValue v = ToJSValue(ctx, p.vertices[i]);
-      vcache[p.vertices[i]] = v;
-      vertices.Set(i, v);
+  // src: polygon array, polygon soup or undefined (empty tree).
+  JSValue Build(JSContext* ctx, JSValueConst src, JSValueConst options) {
+    geom::BSPBuildOptions opts;
+    bool float32 = false;
+    double eps;
+    if (!ToBuildOptions(ValueHolder(ctx, options, true), opts, eps,
+                        &float32)) {
+      return JS_EXCEPTION;
+    }
+    eps = fmax(std::isnan(eps) ? DEFAULT_EPSILON : eps, MIN_EPSILON);
+    if (JS_IsArray(ctx, src)) {
+      vector<JSPolygon> polygons;
+      ToPolygons(ValueHolder(ctx, src, true), polygons);
+      singlePrecision = float32;
+      BuildTree(polygons, eps, opts);
     } else {
-      vertices.Set(i, JS_DupValue(ctx, c->second));
+      vector<SoupPolygon> polygons;
+      if (!JS_IsUndefined(src) &&
+          !ToPolygonSoup(ValueHolder(ctx, src, true), polygons)) {
+        JS_ThrowTypeError(ctx, "invalid polygon soup");
+        return JS_EXCEPTION;
+      }
+      singlePrecision = float32;
+      BuildTree(polygons, eps, opts);
     }
+    threads = opts.threads;
+    return JS_UNDEFINED;
   }
-  // TODO: shared, plane
-  obj.Set("vertices", vertices);
-  obj.Set("src", JS_DupValue(ctx, p.opaque));
-  return unwrap(std::move(obj));
-}
-
-geom::Vector3 ToVector3(ValueHolder&& v) {
-  return geom::Vector3(v["x"].To<double>(), v["y"].To<double>(),
-                       v["z"].To<double>());
-}
-
-geom::Plane ToPlane(ValueHolder&& v) {
-  return geom::Plane(ToVector3(v["normal"]), v["w"].To<double>());
-}
-
-JSPolygon ToPolygon(ValueHolder&& v) {
-  auto vv = v["vertices"];
-  uint32_t sz = vv.Length();
-  vector<geom::Vector3> vertices(sz);
-  for (uint32_t i = 0; i < sz; i++) {
-    vertices[i] = ToVector3(vv[i]);
-  }
-
-  JSValue o = v.GetValueNoDup();  // JS_DupValue in ToJSValue
-  return JSPolygon(vertices, o, ToPlane(v["plane"]));
-}
-
-JSPolygon ToPolygon(ValueHolder&& v, unordered_map<geom::Vector3, JSValue>& vcache) {
-  auto vv = v["vertices"];
-  uint32_t sz = vv.Length();
-  vector<geom::Vector3> vertices(sz);
-  for (uint32_t i = 0; i < sz; i++) {
-    vertices[i] = ToVector3(vv[i]);
-    vcache[vertices[i]] = vv[i].GetValueNoDup();
-  }
-  JSValue o = v.GetValueNoDup();  // JS_DupValue in ToJSValue
-  return JSPolygon(vertices, o, ToPlane(v["plane"]));
-}
 
-void ToPolygons(ValueHolder&& v, vector<JSPolygon>& polygons) {
-  uint32_t sz = v.Length();
-  for (uint32_t i = 0; i < sz; i++) {
-    polygons.push_back(ToPolygon(v[i]));
+  template <typename O>
+  void BuildTree(const vector<geom::Polygon<double, O>>& polygons, double eps,
+                 const geom::BSPBuildOptions& opts) {
+    if (singlePrecision) {
+      nodeF.build(geom::castPolygons<float>(polygons), (float)eps, opts);
+      node = geom::BSPNode();
+    } else {
+      node.build(polygons, eps, opts);
+      nodeF = geom::BSPNodeF();
+    }
   }
-}
 
-void ToJSArray(const vector<JSPolygon>& polygons, ValueHolder&& v,
-               unordered_map<geom::Vector3, JSValue>& vcache) {
-  uint32_t offset = v.Length();
-  for (uint32_t i = 0; i < polygons.size(); i++) {
-    v.Set(i + offset, ToJSValue(v.ctx, polygons[i], vcache));
+  // Splits the polygons with the tree of the selected precision. The float
+  // tree only provides the planes; the polygons are split in double, so the
+  // fragments which are not split keep their original vertices.
+  template <typename O>
+  void Split(const vector<geom::Polygon<double, O>>& polygons,
+             vector<geom::Polygon<double, O>>& inner,
+             vector<geom::Polygon<double, O>>& outer, double eps,
+             unsigned int threads) const {
+    if (singlePrecision) {
+      nodeF.splitPolygons(polygons, inner, outer, (float)eps, threads);
+    } else {
+      node.splitPolygons(polygons, inner, outer, eps, threads);
+    }
   }
-}
-
-class JSBSPTree : public JSClassBase<JSBSPTree> {
- public:
-  static const JSCFunctionListEntry proto_funcs[];
 
-  geom::BSPNode node;
-  JSBSPTree(JSContext* ctx, JSValueConst this_val, int argc,
-            JSValueConst* argv) {
-    if (argc > 0) {
-      Build(ctx, argv[0], DEFAULT_EPSILON);
+  // returns the ray parameter of the nearest hit, or -1.
+  double RaycastDistance(const geom::Ray& ray, double eps) const {
+    if (singlePrecision) {
+      geom::RayT<float> r{ray.origin.cast<float>(),
+                          ray.direction.cast<float>()};
+      return nodeF.raycastDistance(r, (float)eps);
     }
+    return node.raycastDistance(ray, eps);
   }
 
-  void Build(JSContext* ctx, JSValueConst src, double eps) {
-    vector<JSPolygon> polygons;
-    eps = fmax(std::isnan(eps) ? DEFAULT_EPSILON : eps, MIN_EPSILON);
-    ToPolygons(ValueHolder(ctx, src, true), polygons);
-    node.build(polygons, eps);
+  uint32_t NodeCount() {
+    return (uint32_t)(singlePrecision ? nodeF.size() : node.size());
+  }
+  uint32_t Depth() {
+    return (uint32_t)(singlePrecision ? nodeF.depth() : node.depth());
   }
+  std::string Precision() { return singlePrecision ? "float" : "double"; }
 
   JSValue SplitPolygons(JSContext* ctx, JSValueConst src, JSValueConst in,
                         JSValueConst out, double eps) {
@@ -129,7 +112,7 @@ class JSBSPTree : public JSClassBase<JSBSPTree> {
     ToPolygons(ValueHolder(ctx, src, true), polygons);
     vector<JSPolygon> inner;
     vector<JSPolygon> outer;
-    node.splitPolygons(polygons, inner, outer, eps);
+    Split(polygons, inner, outer, eps, threads);
     unordered_map<geom::Vector3, JSValue> vcache;
     if (JS_IsArray(ctx, in)) {
       ToJSArray(inner, ValueHolder(ctx, in, true), vcache);
@@ -149,50 +132,152 @@ class JSBSPTree : public JSClassBase<JSBSPTree> {
 
     ValueHolder pp(ctx, src, true);
     uint32_t sz = pp.Length();
+    unordered_map<geom::Vector3, JSValue> vcache;
+    vector<JSPolygon> polygons;
+    polygons.reserve(sz);
+    for (uint32_t i = 0; i < sz; i++) {
+      polygons.push_back(ToPolygon(pp[i], vcache));
+    }
+
+    // Polygons are clipped independently. Only native data is touched here.
+    vector<vector<JSPolygon>> clipped(sz);
+    vector<char> unchanged(sz);
+    parallel_for(
+        sz,
+        [&](size_t i) {
+          vector<JSPolygon> inner;
+          vector<JSPolygon> outer;
+          Split(vector<JSPolygon>{polygons[i]}, inner, outer, eps, 1);
+          unchanged[i] = (returnInner ? outer : inner).size() == 0;
+          if (!unchanged[i]) {
+            clipped[i] = std::move(returnInner ? inner : outer);
+          }
+        },
+        threads);
+
     JSValue arr = JS_NewArray(ctx);
     ValueHolder ret(ctx, arr);
-    unordered_map<geom::Vector3, JSValue> vcache;
     for (uint32_t i = 0; i < sz; i++) {
-      vector<JSPolygon> inner;
-      vector<JSPolygon> outer;
-      vector<JSPolygon> polygons{ToPolygon(pp[i], vcache)};
-      node.splitPolygons(polygons, inner, outer, eps);
-      if ((returnInner ? outer : inner).size() == 0) {
+      if (unchanged[i]) {
         ret.Set(ret.Length(), pp[i]);
       } else {
-        ToJSArray(returnInner ? inner : outer, ValueHolder(ctx, arr, true),
-                  vcache);
+        ToJSArray(clipped[i], ValueHolder(ctx, arr, true), vcache);
       }
     }
     return unwrap(std::move(ret));
   }
 
+  // returns {inner, outer} polygon soups.
+  JSValue SplitPolygonSoup(JSContext* ctx, JSValueConst src, double eps) {
+    eps = fmax(std::isnan(eps) ? DEFAULT_EPSILON : eps, MIN_EPSILON);
+    vector<SoupPolygon> polygons;
+    bool float32 = false;
+    if (!ToPolygonSoup(ValueHolder(ctx, src, true), polygons, &float32)) {
+      JS_ThrowTypeError(ctx, "invalid polygon soup");
+      return JS_EXCEPTION;
+    }
+    vector<SoupPolygon> inner;
+    vector<SoupPolygon> outer;
+    Split(polygons, inner, outer, eps, threads);
+    ValueHolder ret(ctx);
+    ret.Set("inner", ToJSPolygonSoup(ctx, inner, float32));
+    ret.Set("outer", ToJSPolygonSoup(ctx, outer, float32));
+    return unwrap(std::move(ret));
+  }
+
+  JSValue ClipPolygonSoup(JSContext* ctx, JSValueConst src, bool returnInner,
+                          double eps) {
+    eps = fmax(std::isnan(eps) ? DEFAULT_EPSILON : eps, MIN_EPSILON);
+    vector<SoupPolygon> polygons;
+    bool float32 = false;
+    if (!ToPolygonSoup(ValueHolder(ctx, src, true), polygons, &float32)) {
+      JS_ThrowTypeError(ctx, "invalid polygon soup");
+      return JS_EXCEPTION;
+    }
+    return ToJSPolygonSoup(
+        ctx,
+        singlePrecision
+            ? geom::clipPolygons(nodeF, polygons, returnInner, eps, threads)
+            : geom::clipPolygons(node, polygons, returnInner, eps, threads),
+        float32);
+  }
+
   JSValue Raycast(JSContext* ctx, JSValueConst rayobj, double eps) {
     if (!JS_IsObject(rayobj)) {
       return JS_EXCEPTION;
     }
     eps = fmax(std::isnan(eps) ? DEFAULT_EPSILON : eps, MIN_EPSILON);
     ValueHolder r(ctx, rayobj, true);
-    geom::Ray ray(ToVector3(r["origin"]), ToVector3(r["direction"]));
-    geom::Vector3 result;
-    if (node.raycast(ray, result, eps)) {
-      return ToJSValue(ctx, result);
+    geom::Ray ray(ToVector3(r[atoms(ctx).origin]),
+                  ToVector3(r[atoms(ctx).direction]));
+    double t = RaycastDistance(ray, eps);
+    if (t >= 0) {
+      return ToJSValue(ctx, ray.origin + ray.direction * t);
     }
     return JS_NULL;
   }
 
+  // rays: [ox, oy, oz, dx, dy, dz, ...]
+  // returns [x, y, z, t, ...]. t is the ray parameter of the hit point, or -1
+  // (with x, y, z = NaN) if the ray does not hit.
+  JSValue RaycastBatch(JSContext* ctx, JSValueConst rays, double eps) {
+    size_t length;
+    const double* r = GetTypedArrayData<double>(ctx, rays, &length);
+    if (!r) {
+      JS_ThrowTypeError(ctx, "Float64Array required");
+      return JS_EXCEPTION;
+    }
+    if (length % 6 != 0) {
+      JS_ThrowRangeError(ctx, "length must be a multiple of 6");
+      return JS_EXCEPTION;
+    }
+    eps = fmax(std::isnan(eps) ? DEFAULT_EPSILON : eps, MIN_EPSILON);
+
+    const size_t CHUNK_SIZE = 256;
+    size_t count = length / 6;
+    vector<double> result(count * 4);
+    parallel_for(
+        (count + CHUNK_SIZE - 1) / CHUNK_SIZE,
+        [&](size_t c) {
+          size_t end = std::min(count, (c + 1) * CHUNK_SIZE);
+          for (size_t i = c * CHUNK_SIZE; i < end; i++) {
+            const double* p = r + i * 6;
+            geom::Ray ray(geom::Vector3(p[0], p[1], p[2]),
+                          geom::Vector3(p[3], p[4], p[5]));
+            double t = RaycastDistance(ray, eps);
+            geom::Vector3 hit = t < 0 ? geom::Vector3(NAN, NAN, NAN)
+                                      : ray.origin + ray.direction * t;
+            result[i * 4] = hit.x;
+            result[i * 4 + 1] = hit.y;
+            result[i * 4 + 2] = hit.z;
+            result[i * 4 + 3] = t;
+          }
+        },
+        threads);
+    return NewTypedArray(ctx, result.data(), result.size());
+  }
+
   // returns 0:coplanar, 1:out, 2:in
-  int ClassifyPoint(JSContext* ctx, JSValueConst v, double eps) {
-    return node.classifyPoint(ToVector3(ValueHolder(ctx, v, true)), eps);
+  int ClassifyPoint(const geom::Vector3& v, double eps) {
+    if (singlePrecision) {
+      return nodeF.classifyPoint(v.cast<float>(), (float)eps);
+    }
+    return node.classifyPoint(v, eps);
   }
 };
 
 const JSCFunctionListEntry JSBSPTree::proto_funcs[] = {
     function_entry<&Build>("build"),
+    function_entry_getset<&NodeCount>("nodeCount"),
+    function_entry_getset<&Depth>("depth"),
+    function_entry_getset<&Precision>("precision"),
     function_entry<&ClassifyPoint>("classifyPoint"),
     function_entry<&SplitPolygons>("splitPolygons"),
     function_entry<&ClipPolygons>("clipPolygons"),
+    function_entry<&SplitPolygonSoup>("splitPolygonSoup"),
+    function_entry<&ClipPolygonSoup>("clipPolygonSoup"),
     function_entry<&Raycast>("raycast"),
+    function_entry<&RaycastBatch>("raycastBatch"),
 };
 
 static int ModuleInit(JSContext* ctx, JSModuleDef* m) {
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "JSGeometry.h"
+#include "bvh.h"
+#include "parallel.h"
+#include "qjsutils.h"
+
+bool GetObjectTriangles(JSContext* ctx, JSValueConst obj,
+                        std::vector<geom::Vector3>& positions,
+                        std::vector<uint32_t>& faces);
+
+//---------------------------------------------------------------------------------------------------------------------
+// BVH
+//---------------------------------------------------------------------------------------------------------------------
+
+class JSBVH : public JSClassBase<JSBVH> {
+ public:
+  static const JSCFunctionListEntry proto_funcs[];
+
+  geom::BVH bvh;
+  std::vector<uint32_t> faces;  // face index of each triangle.
+
+  JSBVH(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv) {
+    if (argc > 0) {
+      Build(ctx, argv[0]);
+    }
+  }
+
+  // Builds from the faces of an MQObject in its local coordinates.
+  JSValue Build(JSContext* ctx, JSValueConst obj) {
+    std::vector<geom::Vector3> positions;
+    std::vector<uint32_t> triangleFaces;
+    if (!GetObjectTriangles(ctx, obj, positions, triangleFaces)) {
+      return JS_EXCEPTION;
+    }
+    std::vector<geom::Triangle> triangles;
+    triangles.reserve(triangleFaces.size());
+    faces.clear();
+    for (size_t i = 0; i < triangleFaces.size(); i++) {
+      geom::Triangle t{positions[i * 3], positions[i * 3 + 1],
+                       positions[i * 3 + 2]};
+      if (t.normal().lengthSqr() > 0) {  // skip degenerate triangles.
+        triangles.push_back(t);
+        faces.push_back(triangleFaces[i]);
+      }
+    }
+    bvh.build(triangles);
+    return JS_UNDEFINED;
+  }
+
+  uint32_t NodeCount() { return (uint32_t)bvh.size(); }
+  uint32_t TriangleCount() { return (uint32_t)bvh.triangleCount(); }
+
+  // returns {position, distance, face} or null.
+  JSValue Raycast(JSContext* ctx, JSValueConst rayobj, double maxDistance) {
+    if (!JS_IsObject(rayobj)) {
+      return JS_EXCEPTION;
+    }
+    ValueHolder r(ctx, rayobj, true);
+    geom::Ray ray(ToVector3(r[atoms(ctx).origin]),
+                  ToVector3(r[atoms(ctx).direction]));
+    double t;
+    uint32_t id;
+    if (!bvh.raycast(ray, t, id, 0,
+                     std::isnan(maxDistance) ? INFINITY : maxDistance)) {
+      return JS_NULL;
+    }
+    return NewHit(ctx, ray.origin + ray.direction * t, t, faces[id]);
+  }
+
+  // returns {position, distance, face} or null.
+  JSValue ClosestPoint(JSContext* ctx, const geom::Vector3& p,
+                       double maxDistance) {
+    geom::Vector3 result;
+    uint32_t id;
+    if (!bvh.closestPoint(p, result, id,
+                          std::isnan(maxDistance) ? INFINITY : maxDistance)) {
+      return JS_NULL;
+    }
+    return NewHit(ctx, result, (result - p).length(), faces[id]);
+  }
+
+  // returns indices of the faces intersecting the triangle.
+  JSValue Overlaps(JSContext* ctx, JSValueConst triangle, double eps) {
+    ValueHolder v(ctx, triangle, true);
+    if (!v.IsArray() || v.Length() != 3) {
+      JS_ThrowTypeError(ctx, "triangle required");
+      return JS_EXCEPTION;
+    }
+    geom::Triangle t{ToVector3(v[0U]), ToVector3(v[1U]), ToVector3(v[2U])};
+    std::vector<uint32_t> ids;
+    bvh.overlaps(t, ids, std::isnan(eps) ? 0 : eps);
+    std::vector<uint32_t> result;
+    for (uint32_t id : ids) {
+      result.push_back(faces[id]);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    ValueHolder ret(ctx, JS_NewArray(ctx));
+    for (uint32_t i = 0; i < result.size(); i++) {
+      ret.Set(i, result[i]);
+    }
+    return unwrap(std::move(ret));
+  }
+
+ private:
+  JSValue NewHit(JSContext* ctx, const geom::Vector3& position, double distance,
+                 uint32_t face) {
+    const AtomTable& a = atoms(ctx);
+    ValueHolder hit(ctx);
+    hit.Set(a.position, ToJSValue(ctx, position));
+    hit.Set(a.distance, distance);
+    hit.Set(a.face, face);
+    return unwrap(std::move(hit));
+  }
+};
+
+const JSCFunctionListEntry JSBVH::proto_funcs[] = {
+    function_entry<&Build>("build"),
+    function_entry_getset<&NodeCount>("nodeCount"),
+    function_entry_getset<&TriangleCount>("triangleCount"),
+    function_entry<&Raycast>("raycast"),
+    function_entry<&ClosestPoint>("closestPoint"),
+    function_entry<&Overlaps>("overlaps"),
+};
+
+// (obj: MQObject, epsilon?: number) => Uint32Array
+// returns indices of the faces intersecting other faces of the object. Faces
+// which only touch (e.g. share an edge) or overlap on the same plane are not
+// reported.
+static JSValue FindSelfIntersections(JSContext* ctx, JSValueConst this_val,
+                                     int argc, JSValueConst* argv) {
+  std::vector<geom::Vector3> positions;
+  std::vector<uint32_t> faces;
+  if (argc < 1 || !GetObjectTriangles(ctx, argv[0], positions, faces)) {
+    JS_ThrowTypeError(ctx, "MQObject required");
+    return JS_EXCEPTION;
+  }
+  double eps = argc > 1 ? convert_jsvalue<double>(ctx, argv[1]) : NAN;
+  eps = std::isnan(eps) ? DEFAULT_EPSILON : eps;
+
+  std::vector<geom::Triangle> triangles(faces.size());
+  for (size_t i = 0; i < faces.size(); i++) {
+    triangles[i] = {positions[i * 3], positions[i * 3 + 1],
+                    positions[i * 3 + 2]};
+  }
+  geom::BVH bvh(triangles);
+  std::vector<char> hit(triangles.size());
+  parallel_for(triangles.size(), [&](size_t i) {
+    if (triangles[i].normal().lengthSqr() == 0) {
+      return;
+    }
+    std::vector<uint32_t> ids;
+    bvh.overlaps(triangles[i], ids, eps);
+    for (uint32_t id : ids) {
+      if (faces[id] != faces[i] && triangles[id].normal().lengthSqr() > 0) {
+        hit[i] = true;
+        break;
+      }
+    }
+  });
+
+  std::vector<uint32_t> result;
+  for (size_t i = 0; i < hit.size(); i++) {
+    if (hit[i] && (result.empty() || result.back() != faces[i])) {
+      result.push_back(faces[i]);
+    }
+  }
+  return NewTypedArray(ctx, result.data(), result.size());
+}
+
+const JSCFunctionListEntry bvh_funcs[] = {
+    function_entry("findSelfIntersections", 2, FindSelfIntersections),
+};
+
+static int ModuleInit(JSContext* ctx, JSModuleDef* m) {
+  JS_SetModuleExport(ctx, m, "BVH", newClassConstructor<JSBVH>(ctx, "BVH"));
+  return JS_SetModuleExportList(ctx, m, bvh_funcs, (int)std::size(bvh_funcs));
+}
+
+JSModuleDef* InitBVHModule(JSContext* ctx) {
+  JSModuleDef* m;
+  m = JS_NewCModule(ctx, "bvh", ModuleInit);
+  if (!m) {
+    return NULL;
+  }
+  JS_AddModuleExport(ctx, m, "BVH");
+  JS_AddModuleExportList(ctx, m, bvh_funcs, (int)std::size(bvh_funcs));
+  return m;
+}
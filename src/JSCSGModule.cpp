@@ -0,0 +1,365 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "JSGeometry.h"
+#include "csg.h"
+#include "merge.h"
+#include "qjsutils.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// CSG
+//---------------------------------------------------------------------------------------------------------------------
+
+template <typename T>
+using CSGOperation = std::vector<geom::Polygon<T, JSValue>> (*)(
+    const std::vector<geom::Polygon<T, JSValue>>&,
+    const std::vector<geom::Polygon<T, JSValue>>&, T,
+    const geom::BSPBuildOptions&);
+
+// (a: BSPPolygon[], b: BSPPolygon[], options?) => {vertices, plane, src}[]
+// opF is used if options.precision is "float".
+template <CSGOperation<double> op, CSGOperation<float> opF>
+static JSValue CSGFunction(JSContext* ctx, JSValueConst this_val, int argc,
+                           JSValueConst* argv) {
+  if (argc < 2 || !JS_IsArray(ctx, argv[0]) || !JS_IsArray(ctx, argv[1])) {
+    JS_ThrowTypeError(ctx, "polygon arrays required");
+    return JS_EXCEPTION;
+  }
+  geom::BSPBuildOptions opts;
+  bool singlePrecision = false;
+  double eps;
+  if (!ToBuildOptions(
+          ValueHolder(ctx, argc > 2 ? argv[2] : JS_UNDEFINED, true), opts, eps,
+          &singlePrecision)) {
+    return JS_EXCEPTION;
+  }
+  eps = fmax(std::isnan(eps) ? DEFAULT_EPSILON : eps, MIN_EPSILON);
+
+  std::vector<JSPolygon> a, b;
+  ToPolygons(ValueHolder(ctx, argv[0], true), a);
+  ToPolygons(ValueHolder(ctx, argv[1], true), b);
+  std::vector<JSPolygon> result =
+      singlePrecision
+          ? geom::castPolygons<double>(opF(geom::castPolygons<float>(a),
+                                           geom::castPolygons<float>(b),
+                                           (float)eps, opts))
+          : op(a, b, eps, opts);
+
+  std::unordered_map<geom::Vector3, JSValue> vcache;
+  JSValue arr = JS_NewArray(ctx);
+  ToJSArray(result, ValueHolder(ctx, arr, true), vcache, true);
+  return arr;
+}
+
+template <typename T>
+static JSValue MergePolygons(JSContext* ctx, const T* positions, size_t length,
+                             const uint32_t* offsets, size_t count,
+                             const uint32_t* groups, double eps) {
+  auto merged = geom::mergeCoplanarPolygons(positions, length, offsets, count,
+                                            groups, eps);
+  std::vector<T> mergedPositions;
+  std::vector<uint32_t> mergedOffsets{0};
+  std::vector<uint32_t> sources;
+  mergedOffsets.reserve(merged.size() + 1);
+  sources.reserve(merged.size());
+  for (const auto& p : merged) {
+    for (const auto& v : p.vertices) {
+      mergedPositions.push_back((T)v.x);
+      mergedPositions.push_back((T)v.y);
+      mergedPositions.push_back((T)v.z);
+    }
+    mergedOffsets.push_back((uint32_t)(mergedPositions.size() / 3));
+    sources.push_back(p.source);
+  }
+  ValueHolder obj(ctx);
+  obj.Set("positions", NewTypedArray(ctx, mergedPositions.data(),
+                                     mergedPositions.size()));
+  obj.Set("offsets",
+          NewTypedArray(ctx, mergedOffsets.data(), mergedOffsets.size()));
+  obj.Set("sources", NewTypedArray(ctx, sources.data(), sources.size()));
+  return unwrap(std::move(obj));
+}
+
+// ({positions, offsets, groups}, epsilon?) => {positions, offsets, sources}
+// Merges the polygons of the soup which have the same group and share edges.
+// sources[i] is the index of an input polygon merged into the polygon i.
+static JSValue MergePolygons(JSContext* ctx, JSValueConst this_val, int argc,
+                             JSValueConst* argv) {
+  if (argc < 1 || !JS_IsObject(argv[0])) {
+    JS_ThrowTypeError(ctx, "polygon soup required");
+    return JS_EXCEPTION;
+  }
+  double eps = argc > 1 && !JS_IsUndefined(argv[1])
+                   ? to_float64(ctx, argv[1])
+                   : DEFAULT_EPSILON;
+  eps = fmax(std::isnan(eps) ? DEFAULT_EPSILON : eps, 0);
+  ValueHolder soup(ctx, argv[0], true);
+  ValueHolder positions = soup["positions"];
+  ValueHolder offsetsValue = soup["offsets"];
+  ValueHolder groupsValue = soup["groups"];
+  size_t length = 0, count = 0, groupCount = 0;
+  const uint32_t* offsets = GetTypedArrayData<uint32_t>(
+      ctx, offsetsValue.GetValueNoDup(), &count);
+  const uint32_t* groups = GetTypedArrayData<uint32_t>(
+      ctx, groupsValue.GetValueNoDup(), &groupCount);
+  const double* p =
+      GetTypedArrayData<double>(ctx, positions.GetValueNoDup(), &length);
+  const float* pf =
+      p ? nullptr
+        : GetTypedArrayData<float>(ctx, positions.GetValueNoDup(), &length);
+  bool valid = offsets && groups && (p || pf) && count > 0 &&
+               groupCount + 1 >= count && offsets[count - 1] <= length / 3;
+  for (size_t i = 0; valid && i + 1 < count; i++) {
+    valid = offsets[i] <= offsets[i + 1];
+  }
+  if (!valid) {
+    JS_ThrowTypeError(ctx, "invalid polygon soup");
+    return JS_EXCEPTION;
+  }
+  return p ? MergePolygons(ctx, p, length, offsets, count - 1, groups, eps)
+           : MergePolygons(ctx, pf, length, offsets, count - 1, groups, eps);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Result cache
+//---------------------------------------------------------------------------------------------------------------------
+
+// (...values: (string | number | ArrayBufferView)[]) => string
+// 64 bit hash of the contents of the values as a hex string. Not
+// cryptographic, but fast enough to hash whole meshes on every build.
+static JSValue ContentHash(JSContext* ctx, JSValueConst this_val, int argc,
+                           JSValueConst* argv) {
+  uint64_t h = 0x9e3779b97f4a7c15ull;
+  auto mix = [&](uint64_t w) {
+    h = (h ^ w) * 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 31;
+  };
+  auto update = [&](const uint8_t* p, size_t size) {
+    mix(size);
+    for (; size >= 8; p += 8, size -= 8) {
+      uint64_t w;
+      std::memcpy(&w, p, 8);
+      mix(w);
+    }
+    uint64_t w = 0;
+    std::memcpy(&w, p, size);
+    mix(w);
+  };
+  for (int i = 0; i < argc; i++) {
+    if (JS_IsString(argv[i])) {
+      size_t len;
+      const char* str = JS_ToCStringLen(ctx, &len, argv[i]);
+      if (!str) {
+        return JS_EXCEPTION;
+      }
+      mix(1);
+      update((const uint8_t*)str, len);
+      JS_FreeCString(ctx, str);
+    } else if (JS_IsNumber(argv[i])) {
+      double d = to_float64(ctx, argv[i]) + 0.0;  // -0.0 == 0.0
+      mix(2);
+      update((const uint8_t*)&d, sizeof(d));
+    } else {
+      size_t offset, bytes, size;
+      JSValue buf =
+          JS_GetTypedArrayBuffer(ctx, argv[i], &offset, &bytes, nullptr);
+      if (JS_IsException(buf)) {
+        return JS_EXCEPTION;
+      }
+      uint8_t* data = JS_GetArrayBuffer(ctx, &size, buf);
+      JS_FreeValue(ctx, buf);
+      if (!data) {
+        return JS_EXCEPTION;
+      }
+      mix(3);
+      update(data + offset, bytes);
+    }
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)h);
+  return to_jsvalue(ctx, std::string(hex));
+}
+
+// CSG results in a polygon soup with the source face of each polygon.
+struct CachedMesh {
+  std::vector<double> positions;
+  std::vector<uint32_t> offsets;
+  std::vector<double> planes;  // [nx, ny, nz, w, ...]
+  std::vector<int32_t> materials;
+  std::vector<int32_t> faces;
+  std::vector<int32_t> objects;
+
+  size_t Bytes() const {
+    return positions.size() * sizeof(double) +
+           offsets.size() * sizeof(uint32_t) + planes.size() * sizeof(double) +
+           (materials.size() + faces.size() + objects.size()) *
+               sizeof(int32_t);
+  }
+};
+
+// Meshes are kept by the plugin, so they survive script runs. The least
+// recently used meshes are dropped if the total size exceeds the limit.
+class MeshCache {
+  typedef std::list<std::pair<std::string, CachedMesh>> Entries;
+  Entries entries;  // most recently used first.
+  std::unordered_map<std::string, Entries::iterator> index;
+  size_t bytes = 0;
+
+ public:
+  static const size_t LIMIT = 256 * 1024 * 1024;
+
+  static MeshCache& Instance() {
+    static MeshCache cache;
+    return cache;
+  }
+
+  const CachedMesh* Get(const std::string& key) {
+    auto it = index.find(key);
+    if (it == index.end()) {
+      return nullptr;
+    }
+    entries.splice(entries.begin(), entries, it->second);
+    return &it->second->second;
+  }
+
+  void Set(const std::string& key, CachedMesh&& mesh) {
+    Delete(key);
+    bytes += mesh.Bytes();
+    entries.emplace_front(key, std::move(mesh));
+    index[key] = entries.begin();
+    while (bytes > LIMIT && entries.size() > 1) {
+      Delete(entries.back().first);
+    }
+  }
+
+  void Delete(const std::string& key) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+      bytes -= it->second->second.Bytes();
+      entries.erase(it->second);
+      index.erase(it);
+    }
+  }
+
+  void Clear() {
+    entries.clear();
+    index.clear();
+    bytes = 0;
+  }
+};
+
+template <typename T>
+static bool ReadArray(ValueHolder& v, const char* name, std::vector<T>& out) {
+  ValueHolder value = v[name];
+  size_t length;
+  const T* p = GetTypedArrayData<T>(v.ctx, value.GetValueNoDup(), &length);
+  if (p) {
+    out.assign(p, p + length);
+  }
+  return p != nullptr;
+}
+
+// (key: string) => CachedMesh | null
+static JSValue CacheGet(JSContext* ctx, JSValueConst this_val, int argc,
+                        JSValueConst* argv) {
+  if (argc < 1) {
+    return JS_NULL;
+  }
+  const CachedMesh* mesh = MeshCache::Instance().Get(
+      convert_jsvalue<std::string>(ctx, argv[0]));
+  if (!mesh) {
+    return JS_NULL;
+  }
+  ValueHolder obj(ctx);
+  obj.Set("positions",
+          NewTypedArray(ctx, mesh->positions.data(), mesh->positions.size()));
+  obj.Set("offsets",
+          NewTypedArray(ctx, mesh->offsets.data(), mesh->offsets.size()));
+  obj.Set("planes",
+          NewTypedArray(ctx, mesh->planes.data(), mesh->planes.size()));
+  obj.Set("materials",
+          NewTypedArray(ctx, mesh->materials.data(), mesh->materials.size()));
+  obj.Set("faces", NewTypedArray(ctx, mesh->faces.data(), mesh->faces.size()));
+  obj.Set("objects",
+          NewTypedArray(ctx, mesh->objects.data(), mesh->objects.size()));
+  return unwrap(std::move(obj));
+}
+
+// (key: string, mesh: CachedMesh) => void
+static JSValue CacheSet(JSContext* ctx, JSValueConst this_val, int argc,
+                        JSValueConst* argv) {
+  if (argc < 2 || !JS_IsObject(argv[1])) {
+    JS_ThrowTypeError(ctx, "key and mesh required");
+    return JS_EXCEPTION;
+  }
+  ValueHolder v(ctx, argv[1], true);
+  CachedMesh mesh;
+  bool valid = ReadArray(v, "positions", mesh.positions) &&
+               ReadArray(v, "offsets", mesh.offsets) &&
+               ReadArray(v, "planes", mesh.planes) &&
+               ReadArray(v, "materials", mesh.materials) &&
+               ReadArray(v, "faces", mesh.faces) &&
+               ReadArray(v, "objects", mesh.objects);
+  size_t count = mesh.offsets.empty() ? 0 : mesh.offsets.size() - 1;
+  if (!valid || mesh.offsets.empty() || mesh.planes.size() != count * 4 ||
+      mesh.materials.size() != count || mesh.faces.size() != count ||
+      mesh.objects.size() != count ||
+      mesh.offsets.back() > mesh.positions.size() / 3) {
+    JS_ThrowTypeError(ctx, "invalid mesh");
+    return JS_EXCEPTION;
+  }
+  MeshCache::Instance().Set(convert_jsvalue<std::string>(ctx, argv[0]),
+                            std::move(mesh));
+  return JS_UNDEFINED;
+}
+
+// (key?: string) => void
+// Deletes the mesh of the key, or all the meshes.
+static JSValue CacheClear(JSContext* ctx, JSValueConst this_val, int argc,
+                          JSValueConst* argv) {
+  if (argc > 0 && !JS_IsUndefined(argv[0])) {
+    MeshCache::Instance().Delete(convert_jsvalue<std::string>(ctx, argv[0]));
+  } else {
+    MeshCache::Instance().Clear();
+  }
+  return JS_UNDEFINED;
+}
+
+const JSCFunctionListEntry csg_funcs[] = {
+    function_entry("union", 3,
+                   CSGFunction<geom::csgUnion<double, JSValue>,
+                               geom::csgUnion<float, JSValue>>),
+    function_entry("subtract", 3,
+                   CSGFunction<geom::csgSubtract<double, JSValue>,
+                               geom::csgSubtract<float, JSValue>>),
+    function_entry("intersect", 3,
+                   CSGFunction<geom::csgIntersect<double, JSValue>,
+                               geom::csgIntersect<float, JSValue>>),
+    function_entry("mergePolygons", 2, MergePolygons),
+    function_entry("contentHash", 1, ContentHash),
+    function_entry("cacheGet", 1, CacheGet),
+    function_entry("cacheSet", 2, CacheSet),
+    function_entry("cacheClear", 1, CacheClear),
+};
+
+static int CSGModuleInit(JSContext* ctx, JSModuleDef* m) {
+  return JS_SetModuleExportList(ctx, m, csg_funcs, (int)std::size(csg_funcs));
+}
+
+JSModuleDef* InitCSGModule(JSContext* ctx) {
+  JSModuleDef* m;
+  m = JS_NewCModule(ctx, "csg", CSGModuleInit);
+  if (!m) {
+    return NULL;
+  }
+  JS_AddModuleExportList(ctx, m, csg_funcs, (int)std::size(csg_funcs));
+  return m;
+}
@@ -14,6 +14,7 @@ class JsContext {
     JSValue func;
   };
   std::vector<TimerEntry> timers;
+  JSValue vector3Proto = JS_UNDEFINED;  // Vector3.prototype of core.js
   JsContext(JSRuntime *runtime,
             const std::vector<std::string> &argv = std::vector<std::string>()) {
     ctx = JS_NewContext(runtime);
@@ -36,6 +37,27 @@ class JsContext {
   }
 
   ValueHolder GetGlobal() { return ValueHolder(ctx, JS_GetGlobalObject(ctx)); }
+
+  // Creates a Vector3 without calling its constructor. Returns JS_UNDEFINED
+  // if core.js has not registered the class yet.
+  JSValue NewVector3(double x, double y, double z) {
+    if (JS_IsUndefined(vector3Proto)) {
+      ValueHolder cls = GetGlobal()["_vector3class"];
+      if (!cls.IsFunction()) {
+        return JS_UNDEFINED;
+      }
+      vector3Proto = cls["prototype"].GetValue();
+    }
+    const AtomTable &a = atoms(ctx);
+    JSValue v = JS_NewObjectProto(ctx, vector3Proto);
+    JS_DefinePropertyValue(ctx, v, a.x.atom, JS_NewFloat64(ctx, x),
+                           JS_PROP_C_W_E);
+    JS_DefinePropertyValue(ctx, v, a.y.atom, JS_NewFloat64(ctx, y),
+                           JS_PROP_C_W_E);
+    JS_DefinePropertyValue(ctx, v, a.z.atom, JS_NewFloat64(ctx, z),
+                           JS_PROP_C_W_E);
+    return v;
+  }
   void RegisterTimerImpl(JSValue f, int32_t time, uint32_t id = 0) {
     timers.push_back(TimerEntry{time, id, f});
   }
@@ -83,6 +105,7 @@ class JsContext {
     for (auto &ent : timers) {
       JS_FreeValue(ctx, ent.func);
     }
+    JS_FreeValue(ctx, vector3Proto);
     JS_FreeContext(ctx);
   }
 
@@ -112,7 +135,6 @@ class JsContext {
     return JS_UNDEFINED;
   }
 
- protected:
   static JsContext *GetJsContext(JSContext *ctx) {
     return (JsContext *)JS_GetContextOpaque(ctx);
   }
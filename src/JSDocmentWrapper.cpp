@@ -1,37 +1,37 @@
 
 #include <windows.h>
 
+#include <algorithm>
 #include <map>
 #include <sstream>
 #include <vector>
 
+#include "JSContext.h"
 #include "MQBasePlugin.h"
 #include "MQWidget.h"
 #include "Utils.h"
+#include "geometry.h"
+#include "geometry_simd.h"
 #include "qjsutils.h"
+#include "triangulate.h"
 
 //---------------------------------------------------------------------------------------------------------------------
 // Vertics
 //---------------------------------------------------------------------------------------------------------------------
 
 JSValue NewVec3(JSContext* ctx, const MQPoint& p) {
-  JSValue g = JS_GetGlobalObject(ctx);
-  JSValue vec = JS_GetPropertyStr(ctx, g, "_vector3class");
-  JS_FreeValue(ctx, g);
-  if (vec != JS_UNDEFINED) {
-    JSValue args[] = { JS_NewFloat64(ctx, p.x), JS_NewFloat64(ctx, p.y),
-                      JS_NewFloat64(ctx, p.z) };
-    JSValue v = JS_CallConstructor(ctx, vec, 3, args);
-    JS_FreeValue(ctx, args[0]);
-    JS_FreeValue(ctx, args[1]);
-    JS_FreeValue(ctx, args[2]);
-    JS_FreeValue(ctx, vec);
-    return v;
+  JsContext* context = JsContext::GetJsContext(ctx);
+  if (context) {
+    JSValue v = context->NewVector3(p.x, p.y, p.z);
+    if (!JS_IsUndefined(v)) {
+      return v;
+    }
   }
+  const AtomTable& a = atoms(ctx);
   ValueHolder v(ctx);
-  v.Set("x", p.x);
-  v.Set("y", p.y);
-  v.Set("z", p.z);
+  v.Set(a.x, p.x);
+  v.Set(a.y, p.y);
+  v.Set(a.z, p.z);
   return unwrap(std::move(v));
 }
 
@@ -52,11 +52,20 @@ JSValue ToJSValue(JSContext* ctx, const MQMatrix& mat) {
 }
 
 MQPoint ToMQPoint(JSContext* ctx, JSValueConst value) {
-  ValueHolder v(ctx, value, true);
-  if (v.IsArray() && v.Length() == 3) {
-    return MQPoint(v[0U].To<float>(), v[1U].To<float>(), v[2U].To<float>());
+  if (JS_IsArray(ctx, value)) {
+    ValueHolder v(ctx, value, true);
+    if (v.Length() == 3) {
+      return MQPoint(v[0U].To<float>(), v[1U].To<float>(), v[2U].To<float>());
+    }
   }
-  return MQPoint(v["x"].To<float>(), v["y"].To<float>(), v["z"].To<float>());
+  double xyz[3];
+  get_xyz(ctx, value, xyz);
+  return MQPoint((float)xyz[0], (float)xyz[1], (float)xyz[2]);
+}
+
+template <>
+static inline MQPoint convert_jsvalue(JSContext* ctx, JSValue v) {
+  return ToMQPoint(ctx, v);
 }
 
 MQAngle ToMQAngle(JSContext* ctx, JSValueConst value) {
@@ -83,7 +92,7 @@ class VertexArray : public JSClassBase<VertexArray> {
       p.y = convert_jsvalue<float>(ctx, arg1);
       p.z = convert_jsvalue<float>(ctx, arg2);
     } else {
-      p = ToMQPoint(ctx, arg0);
+      p = convert_jsvalue<MQPoint>(ctx, arg0);
     }
     return obj->AddVertex(p);
   }
@@ -91,18 +100,57 @@ class VertexArray : public JSClassBase<VertexArray> {
   JSValue GetVertex(JSContext* ctx, int index) {
     MQPoint p = obj->GetVertex(index);
     ValueHolder v(ctx, NewVec3(ctx, p));
-    v.Set("id", obj->GetVertexUniqueID(index));
-    v.Set("refs", obj->GetVertexRefCount(index));
+    v.Set(atoms(ctx).id, obj->GetVertexUniqueID(index));
+    v.Set(atoms(ctx).refs, obj->GetVertexRefCount(index));
     return unwrap(std::move(v));
   }
 
   void SetVertex(JSContext* ctx, JSValueConst value, int index) {
-    obj->SetVertex(index, ToMQPoint(ctx, value));
+    obj->SetVertex(index, convert_jsvalue<MQPoint>(ctx, value));
   }
   bool DeleteVertex(JSContext* ctx, JSValueConst value) {
     obj->DeleteVertex(convert_jsvalue<int>(ctx, value));
     return true;
   }
+
+  // returns [x0, y0, z0, x1, ...] of all vertices.
+  template <typename T>
+  JSValue ToTypedArray(JSContext* ctx) {
+    static_assert(sizeof(MQPoint) == sizeof(float) * 3);
+    std::vector<MQPoint> points(obj->GetVertexCount());
+    if (!points.empty()) {
+      obj->GetVertexArray(points.data());
+    }
+    if constexpr (std::is_same_v<T, float>) {
+      return NewTypedArray(ctx, &points.data()->x, points.size() * 3);
+    } else {
+      std::vector<T> data(points.size() * 3);
+      for (size_t i = 0; i < points.size(); i++) {
+        data[i * 3] = points[i].x;
+        data[i * 3 + 1] = points[i].y;
+        data[i * 3 + 2] = points[i].z;
+      }
+      return NewTypedArray(ctx, data.data(), data.size());
+    }
+  }
+
+  // Sets positions of the vertices from [x0, y0, z0, x1, ...]. Returns the
+  // number of updated vertices.
+  template <typename T>
+  JSValue SetFromTypedArray(JSContext* ctx, JSValueConst value) {
+    size_t length;
+    const T* data = GetTypedArrayData<T>(ctx, value, &length);
+    if (!data) {
+      JS_ThrowTypeError(ctx, "%s required", typed_array_traits<T>::name);
+      return JS_EXCEPTION;
+    }
+    int count = std::min(obj->GetVertexCount(), (int)(length / 3));
+    for (int i = 0; i < count; i++) {
+      obj->SetVertex(i, MQPoint((float)data[i * 3], (float)data[i * 3 + 1],
+                                (float)data[i * 3 + 2]));
+    }
+    return to_jsvalue(ctx, count);
+  }
 };
 
 template <auto method>
@@ -115,10 +163,10 @@ int delete_property_handler(JSContext* ctx, JSValueConst obj, JSAtom prop) {
   return reti;
 }
 
-static JSClassExoticMethods VertexArray_exotic{
-    .get_own_property = indexed_propery_handler<&VertexArray::GetVertex,
-                                                &VertexArray::SetVertex>,
-    .delete_property = delete_property_handler<&VertexArray::DeleteVertex> };
+static JSClassExoticMethods VertexArray_exotic =
+    indexed_exotic_methods<&VertexArray::GetVertex, &VertexArray::SetVertex,
+                           &VertexArray::Length>(
+        delete_property_handler<&VertexArray::DeleteVertex>);
 
 // JSClassID VertexArray::class_id;
 
@@ -126,6 +174,10 @@ const JSCFunctionListEntry VertexArray::proto_funcs[] = {
     function_entry_getset<&Length>("length"),
     function_entry<&Append>("append"),
     function_entry<&Append>("push"),
+    function_entry<&ToTypedArray<float>>("toFloat32Array"),
+    function_entry<&ToTypedArray<double>>("toFloat64Array"),
+    function_entry<&SetFromTypedArray<float>>("setFromFloat32Array"),
+    function_entry<&SetFromTypedArray<double>>("setFromFloat64Array"),
 };
 
 JSValue NewVertexArray(JSContext* ctx, MQObject o) {
@@ -171,8 +223,8 @@ class FaceWrapper {
     obj->GetFaceCoordinateArray(index, uva.data());
     for (int i = 0; i < count; i++) {
       ValueHolder u(ctx);
-      u.Set("u", uva[i].u);
-      u.Set("v", uva[i].v);
+      u.Set(atoms(ctx).u, uva[i].u);
+      u.Set(atoms(ctx).v, uva[i].v);
       points.Set(i, u);
     }
     return points.GetValue();
@@ -213,8 +265,8 @@ class FaceArray {
     ValueHolder v(ctx, points, true);
     uint32_t count = v.Length();
     if (count == 0) {
-      mat = v["material"].To<int>();
-      v = v["points"];
+      mat = v[atoms(ctx).material].To<int>();
+      v = v[atoms(ctx).points];
     }
     std::vector<int> indices(count);
     for (uint32_t i = 0; i < count; i++) {
@@ -235,7 +287,7 @@ class FaceArray {
 
   void SetFace(JSContext* ctx, JSValueConst value, int index) {
     ValueHolder face(ctx, value, true);
-    auto points = face["points"];
+    auto points = face[atoms(ctx).points];
     if (points.IsArray()) {
       obj->DeleteFace(index);
       uint32_t count = points.Length();
@@ -245,7 +297,7 @@ class FaceArray {
       }
       obj->InsertFace(index, count, indices.data());
     }
-    auto mat = face["material"];
+    auto mat = face[atoms(ctx).material];
     if (!mat.IsUndefined()) {
       obj->SetFaceMaterial(index, mat.To<int>());
     }
@@ -253,12 +305,99 @@ class FaceArray {
   bool DeleteFace(JSContext* ctx, JSValueConst value) {
     return obj->DeleteFace(convert_jsvalue<int>(ctx, value));
   }
+
+  // returns {counts, indices, materials}. counts is a Uint8Array unless a
+  // face has more than 255 points. Deleted faces have no points.
+  JSValue ToIndexArrays(JSContext* ctx) {
+    int faceCount = obj->GetFaceCount();
+    std::vector<uint32_t> counts(faceCount);
+    std::vector<int32_t> materials(faceCount);
+    std::vector<uint32_t> indices;
+    uint32_t maxCount = 0;
+    for (int f = 0; f < faceCount; f++) {
+      int count = obj->GetFacePointCount(f);
+      counts[f] = count;
+      materials[f] = obj->GetFaceMaterial(f);
+      maxCount = std::max(maxCount, counts[f]);
+      if (count > 0) {
+        size_t offset = indices.size();
+        indices.resize(offset + count);
+        obj->GetFacePointArray(f, (int*)&indices[offset]);
+      }
+    }
+    ValueHolder ret(ctx);
+    if (maxCount <= 255) {
+      std::vector<uint8_t> counts8(counts.begin(), counts.end());
+      ret.Set("counts", NewTypedArray(ctx, counts8.data(), counts8.size()));
+    } else {
+      ret.Set("counts", NewTypedArray(ctx, counts.data(), counts.size()));
+    }
+    ret.Set("indices", NewTypedArray(ctx, indices.data(), indices.size()));
+    ret.Set("materials",
+            NewTypedArray(ctx, materials.data(), materials.size()));
+    return unwrap(std::move(ret));
+  }
+
+  // Appends faces from {counts, indices, materials?}. Faces without points
+  // are skipped. Returns the number of appended faces.
+  JSValue AppendIndexArrays(JSContext* ctx, JSValueConst value) {
+    ValueHolder v(ctx, value, true);
+    ValueHolder countsValue = v["counts"];
+    ValueHolder indicesValue = v["indices"];
+    ValueHolder materialsValue = v["materials"];
+    size_t faceCount = 0, indexCount = 0, materialCount = 0;
+    const uint8_t* counts8 = GetTypedArrayData<uint8_t>(
+        ctx, countsValue.GetValueNoDup(), &faceCount);
+    const uint32_t* counts32 =
+        counts8 ? nullptr
+                : GetTypedArrayData<uint32_t>(ctx, countsValue.GetValueNoDup(),
+                                              &faceCount);
+    const uint32_t* indices = GetTypedArrayData<uint32_t>(
+        ctx, indicesValue.GetValueNoDup(), &indexCount);
+    const int32_t* materials = GetTypedArrayData<int32_t>(
+        ctx, materialsValue.GetValueNoDup(), &materialCount);
+    if ((!counts8 && !counts32) || !indices) {
+      JS_ThrowTypeError(ctx, "counts and indices required");
+      return JS_EXCEPTION;
+    }
+    size_t total = 0;
+    for (size_t f = 0; f < faceCount; f++) {
+      total += counts8 ? counts8[f] : counts32[f];
+    }
+    if (total > indexCount) {
+      JS_ThrowRangeError(ctx, "not enough indices");
+      return JS_EXCEPTION;
+    }
+    uint32_t vertexCount = (uint32_t)obj->GetVertexCount();
+    for (size_t i = 0; i < total; i++) {
+      if (indices[i] >= vertexCount) {
+        JS_ThrowRangeError(ctx, "vertex index out of range");
+        return JS_EXCEPTION;
+      }
+    }
+    size_t offset = 0;
+    uint32_t appended = 0;
+    for (size_t f = 0; f < faceCount; f++) {
+      int count = counts8 ? counts8[f] : counts32[f];
+      if (count == 0) {
+        continue;  // deleted face.
+      }
+      int face = obj->AddFace(count, (int*)&indices[offset]);
+      offset += count;
+      if (face < 0) {
+        continue;
+      }
+      obj->SetFaceMaterial(face, f < materialCount ? materials[f] : 0);
+      appended++;
+    }
+    return to_jsvalue(ctx, appended);
+  }
 };
 
-static JSClassExoticMethods FaceArray_exotic{
-    .get_own_property =
-        indexed_propery_handler<&FaceArray::GetFace, &FaceArray::SetFace>,
-    .delete_property = delete_property_handler<&FaceArray::DeleteFace> };
+static JSClassExoticMethods FaceArray_exotic =
+    indexed_exotic_methods<&FaceArray::GetFace, &FaceArray::SetFace,
+                           &FaceArray::Length>(
+        delete_property_handler<&FaceArray::DeleteFace>);
 
 JSClassID FaceArray::class_id;
 
@@ -266,6 +405,8 @@ const JSCFunctionListEntry FaceArray::proto_funcs[] = {
     function_entry_getset<&Length>("length"),
     function_entry<&AddFace>("append"),
     function_entry<&AddFace>("push"),
+    function_entry<&ToIndexArrays>("toIndexArrays"),
+    function_entry<&AppendIndexArrays>("appendIndexArrays"),
 };
 
 JSValue NewFaceArray(JSContext* ctx, MQObject o) {
@@ -288,15 +429,11 @@ class ObjectTransform : public JSClassBase<ObjectTransform> {
   ObjectTransform(MQObject obj) : obj(obj) {}
 
   JSValue GetScale(JSContext* ctx) { return NewVec3(ctx, obj->GetScaling()); }
-  void SetScale(JSContext* ctx, JSValue v) {
-    obj->SetScaling(ToMQPoint(ctx, v));
-  }
+  void SetScale(const MQPoint& p) { obj->SetScaling(p); }
   JSValue GetPosition(JSContext* ctx) {
     return NewVec3(ctx, obj->GetTranslation());
   }
-  void SetPosition(JSContext* ctx, JSValue v) {
-    obj->SetTranslation(ToMQPoint(ctx, v));
-  }
+  void SetPosition(const MQPoint& p) { obj->SetTranslation(p); }
   JSValue GetRotation(JSContext* ctx) {
     return ToJSValue(ctx, obj->GetRotation());
   }
@@ -442,6 +579,35 @@ class MQObjectWrapper : public JSClassBase<MQObjectWrapper> {
   void OptimizeVertex(float distance) {
     obj->OptimizeVertex(distance, nullptr);
   }
+  // matrix: Matrix4 or 16 numbers. Returns false if matrix is not a matrix.
+  bool ApplyTransform(JSContext* ctx, JSValueConst matrix) {
+    ValueHolder v(ctx, matrix, true);
+    if (!v.IsObject()) {
+      return false;
+    }
+    ValueHolder m = v["m"];
+    if (!m.IsObject()) {
+      m = std::move(v);
+    }
+    if (m.Length() != 16) {
+      return false;
+    }
+    geom::Matrix4 tr;
+    for (uint32_t i = 0; i < 16; i++) {
+      tr[i] = m[i].To<double>();
+    }
+    std::vector<MQPoint> verts(obj->GetVertexCount());
+    if (verts.empty()) {
+      return true;
+    }
+    obj->GetVertexArray(verts.data());
+    static_assert(sizeof(MQPoint) == sizeof(float) * 3);
+    geom::simd::transformPoints(tr, &verts[0].x, &verts[0].x, verts.size());
+    for (int i = 0; i < (int)verts.size(); i++) {
+      obj->SetVertex(i, verts[i]);
+    }
+    return true;
+  }
 };
 
 const JSCFunctionListEntry MQObjectWrapper::proto_funcs[] = {
@@ -461,6 +627,7 @@ const JSCFunctionListEntry MQObjectWrapper::proto_funcs[] = {
     function_entry<&Merge>("merge"),
     function_entry<&Clone>("clone"),
     function_entry<&OptimizeVertex>("optimizeVertex"),
+    function_entry<&ApplyTransform>("applyTransform"),
     function_entry_getset<&GetWireframe, &SetWireframe>("wireframe"),
 };
 
@@ -474,6 +641,92 @@ JSValue NewMQObject(JSContext* ctx, MQObject o, MQDocument doc, int index,
   return obj;
 }
 
+// Triangulates faceCount faces. getFace(f, indices) sets the vertex indices of
+// the face f. Appends the vertex indices of the triangles to triangles and the
+// face index of each triangle to faces. Faces with less than 3 points are
+// skipped. Polygons are ear clipped if doc is null or its triangulation fails.
+template <typename F>
+static void TriangulateFaces(MQDocument doc, const std::vector<MQPoint>& verts,
+                             size_t faceCount, F&& getFace,
+                             std::vector<uint32_t>& triangles,
+                             std::vector<uint32_t>& faces) {
+  std::vector<int> indices;
+  std::vector<MQPoint> points;
+  std::vector<geom::Vector3> polygon;
+  std::vector<int> local;
+  for (size_t f = 0; f < faceCount; f++) {
+    getFace(f, indices);
+    int count = (int)indices.size();
+    if (count < 3) {
+      continue;
+    }
+    local.assign((size_t)(count - 2) * 3, -1);
+    if (count > 3 && doc) {
+      points.resize(count);
+      for (int i = 0; i < count; i++) {
+        points[i] = verts[indices[i]];
+      }
+      doc->Triangulate(points.data(), count, local.data(), (int)local.size());
+    }
+    // Triangles, no document or failed triangulation.
+    if (std::any_of(local.begin(), local.end(),
+                    [&](int i) { return i < 0 || i >= count; })) {
+      polygon.resize(count);
+      for (int i = 0; i < count; i++) {
+        const MQPoint& p = verts[indices[i]];
+        polygon[i] = geom::Vector3{p.x, p.y, p.z};
+      }
+      geom::triangulatePolygon(polygon.data(), count, local.data());
+    }
+    for (int i : local) {
+      triangles.push_back((uint32_t)indices[i]);
+    }
+    faces.insert(faces.end(), local.size() / 3, (uint32_t)f);
+  }
+}
+
+// Triangulates the faces of o. triangles has the vertex indices of the
+// triangles and faces[i] is the face index of the triangle i. verts is set to
+// the vertices of o.
+static void TriangulateObject(MQObjectWrapper* o, std::vector<MQPoint>& verts,
+                              std::vector<uint32_t>& triangles,
+                              std::vector<uint32_t>& faces) {
+  verts.resize(o->obj->GetVertexCount());
+  if (!verts.empty()) {
+    o->obj->GetVertexArray(verts.data());
+  }
+  TriangulateFaces(
+      o->doc, verts, o->obj->GetFaceCount(),
+      [&](size_t f, std::vector<int>& indices) {
+        indices.resize(std::max(o->obj->GetFacePointCount((int)f), 0));
+        if (!indices.empty()) {
+          o->obj->GetFacePointArray((int)f, indices.data());
+        }
+      },
+      triangles, faces);
+}
+
+// Triangulates the faces of a JS MQObject. positions has three vertices per
+// triangle and faces[i] is the face index of the triangle i. Returns false if
+// obj is not an MQObject.
+bool GetObjectTriangles(JSContext* ctx, JSValueConst obj,
+                        std::vector<geom::Vector3>& positions,
+                        std::vector<uint32_t>& faces) {
+  MQObjectWrapper* o = MQObjectWrapper::Unwrap(ctx, obj);
+  if (!o) {
+    return false;
+  }
+  std::vector<MQPoint> verts;
+  std::vector<uint32_t> triangles;
+  TriangulateObject(o, verts, triangles, faces);
+  positions.reserve(positions.size() + triangles.size());
+  for (uint32_t i : triangles) {
+    const MQPoint& p = verts[i];
+    positions.push_back(geom::Vector3(p.x, p.y, p.z));
+  }
+  return true;
+}
+
 //---------------------------------------------------------------------------------------------------------------------
 // MQMaterial
 //---------------------------------------------------------------------------------------------------------------------
@@ -932,6 +1185,90 @@ class MQDocumentWrapper {
     return unwrap(std::move(result));
   }
 
+  // Triangulates the faces of a mesh at once. positions: [x0, y0, z0, ...].
+  // counts[i] is the number of points of the face i, and indices has the
+  // vertex indices of the faces. If indices is omitted, the points of each
+  // face are stored in positions in order. Returns the vertex indices of all
+  // the triangles.
+  JSValue TriangulateFaces(JSContext* ctx, JSValueConst positions,
+                           JSValueConst counts, JSValueConst indices) {
+    std::vector<MQPoint> verts;
+    auto read = [&](const auto* p, size_t length) {
+      verts.resize(length / 3);
+      for (size_t i = 0; i < verts.size(); i++) {
+        verts[i] = MQPoint((float)p[i * 3], (float)p[i * 3 + 1],
+                           (float)p[i * 3 + 2]);
+      }
+    };
+    size_t length = 0, faceCount = 0, indexCount = 0;
+    if (const double* p = GetTypedArrayData<double>(ctx, positions, &length)) {
+      read(p, length);
+    } else if (const float* p =
+                   GetTypedArrayData<float>(ctx, positions, &length)) {
+      read(p, length);
+    } else {
+      JS_ThrowTypeError(ctx, "Float32Array or Float64Array required");
+      return JS_EXCEPTION;
+    }
+    const uint8_t* counts8 =
+        GetTypedArrayData<uint8_t>(ctx, counts, &faceCount);
+    const uint32_t* counts32 =
+        counts8 ? nullptr
+                : GetTypedArrayData<uint32_t>(ctx, counts, &faceCount);
+    const uint32_t* idx =
+        JS_IsUndefined(indices)
+            ? nullptr
+            : GetTypedArrayData<uint32_t>(ctx, indices, &indexCount);
+    if ((!counts8 && !counts32) || (!idx && !JS_IsUndefined(indices))) {
+      JS_ThrowTypeError(ctx, "counts and indices must be typed arrays");
+      return JS_EXCEPTION;
+    }
+    size_t total = 0;
+    for (size_t f = 0; f < faceCount; f++) {
+      total += counts8 ? counts8[f] : counts32[f];
+    }
+    if (total > (idx ? indexCount : verts.size())) {
+      JS_ThrowRangeError(ctx, "not enough indices");
+      return JS_EXCEPTION;
+    }
+    for (size_t i = 0; idx && i < total; i++) {
+      if (idx[i] >= verts.size()) {
+        JS_ThrowRangeError(ctx, "vertex index out of range");
+        return JS_EXCEPTION;
+      }
+    }
+
+    std::vector<uint32_t> triangles, faces;
+    size_t offset = 0;
+    ::TriangulateFaces(
+        doc, verts, faceCount,
+        [&](size_t f, std::vector<int>& points) {
+          uint32_t count = counts8 ? counts8[f] : counts32[f];
+          points.resize(count);
+          for (uint32_t i = 0; i < count; i++) {
+            points[i] = (int)(idx ? idx[offset + i] : offset + i);
+          }
+          offset += count;
+        },
+        triangles, faces);
+    return NewTypedArray(ctx, triangles.data(), triangles.size());
+  }
+
+  // Triangulates the faces of obj without copying its vertices to JS.
+  // Returns {indices, faces}. faces[i] is the face index of the triangle i.
+  JSValue TriangulateObject(JSContext* ctx, MQObjectWrapper* o) {
+    if (!o) {
+      return JS_EXCEPTION;
+    }
+    std::vector<MQPoint> verts;
+    std::vector<uint32_t> triangles, faces;
+    ::TriangulateObject(o, verts, triangles, faces);
+    ValueHolder ret(ctx);
+    ret.Set("indices", NewTypedArray(ctx, triangles.data(), triangles.size()));
+    ret.Set("faces", NewTypedArray(ctx, faces.data(), faces.size()));
+    return unwrap(std::move(ret));
+  }
+
   JSValue CreateDrawingObject(JSContext* ctx, JSValue arg) {
     auto plugin = dynamic_cast<MQStationPlugin*>(GetPluginClass());
     if (!plugin) {
@@ -988,6 +1325,8 @@ const JSCFunctionListEntry MQDocumentWrapper::proto_funcs[] = {
     function_entry<&ClearSelect>("clearSelect"),
     function_entry<&Compact>("compact"),
     function_entry<&Triangulate>("triangulate"),
+    function_entry<&TriangulateFaces>("triangulateFaces"),
+    function_entry<&TriangulateObject>("triangulateObject"),
     function_entry<&GetGlobalMatrix>("getGlobalMatrix"),
     function_entry<&GetPluginData>("getPluginData"),
     function_entry<&SetPluginData>("setPluginData"),
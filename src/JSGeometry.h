@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bsptree.h"
+#include "qjsutils.h"
+
+// Conversions between JS values and geom types.
+
+const double MIN_EPSILON = 1e-10;
+const double DEFAULT_EPSILON = 1e-6;
+typedef geom::Polygon<double, JSValue> JSPolygon;
+
+template <>
+struct std::hash<geom::Vector3> {
+  std::size_t operator()(const geom::Vector3& v) const {
+    std::hash<double> dh;
+    std::size_t h = dh(v.x);
+    h ^= dh(v.y) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= dh(v.z) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+  }
+};
+
+inline JSValue ToJSValue(JSContext* ctx, const geom::Vector3& v) {
+  const AtomTable& a = atoms(ctx);
+  ValueHolder obj(ctx);
+  obj.Set(a.x, v.x);
+  obj.Set(a.y, v.y);
+  obj.Set(a.z, v.z);
+  return unwrap(std::move(obj));
+}
+
+inline JSValue ToJSValue(JSContext* ctx, const geom::Plane& p) {
+  ValueHolder obj(ctx);
+  obj.Set(atoms(ctx).normal, ToJSValue(ctx, p.normal));
+  obj.Set(atoms(ctx).w, p.w);
+  return unwrap(std::move(obj));
+}
+
+inline JSValue ToJSValue(JSContext* ctx, const JSPolygon& p,
+                         std::unordered_map<geom::Vector3, JSValue>& vcache,
+                         bool withPlane = false) {
+  ValueHolder obj(ctx);
+  ValueHolder vertices(ctx, JS_NewArray(ctx));
+  for (uint32_t i = 0; i < p.vertices.size(); i++) {
+    auto c = vcache.find(p.vertices[i]);
+    if (c == vcache.end()) {
+      JSValue v = ToJSValue(ctx, p.vertices[i]);
+      vcache[p.vertices[i]] = v;
+      vertices.Set(i, v);
+    } else {
+      vertices.Set(i, JS_DupValue(ctx, c->second));
+    }
+  }
+  const AtomTable& a = atoms(ctx);
+  obj.Set(a.vertices, vertices);
+  if (withPlane) {
+    obj.Set(a.plane, ToJSValue(ctx, p.plane));
+  }
+  obj.Set(a.src, JS_DupValue(ctx, p.opaque));
+  return unwrap(std::move(obj));
+}
+
+inline geom::Vector3 ToVector3(JSContext* ctx, JSValueConst v) {
+  double xyz[3];
+  get_xyz(ctx, v, xyz);
+  return geom::Vector3(xyz[0], xyz[1], xyz[2]);
+}
+
+inline geom::Vector3 ToVector3(ValueHolder&& v) {
+  return ToVector3(v.ctx, v.GetValueNoDup());
+}
+
+template <>
+static inline geom::Vector3 convert_jsvalue(JSContext* ctx, JSValue v) {
+  return ToVector3(ctx, v);
+}
+
+inline geom::Plane ToPlane(ValueHolder&& v) {
+  const AtomTable& a = atoms(v.ctx);
+  return geom::Plane(ToVector3(v[a.normal]), v[a.w].To<double>());
+}
+
+inline JSPolygon ToPolygon(ValueHolder&& v) {
+  const AtomTable& a = atoms(v.ctx);
+  auto vv = v[a.vertices];
+  uint32_t sz = vv.Length();
+  JSPolygon::TVertices vertices(sz);
+  for (uint32_t i = 0; i < sz; i++) {
+    vertices[i] = ToVector3(vv[i]);
+  }
+
+  JSValue o = v.GetValueNoDup();  // JS_DupValue in ToJSValue
+  return JSPolygon(vertices, o, ToPlane(v[a.plane]));
+}
+
+inline JSPolygon ToPolygon(ValueHolder&& v,
+                           std::unordered_map<geom::Vector3, JSValue>& vcache) {
+  const AtomTable& a = atoms(v.ctx);
+  auto vv = v[a.vertices];
+  uint32_t sz = vv.Length();
+  JSPolygon::TVertices vertices(sz);
+  for (uint32_t i = 0; i < sz; i++) {
+    vertices[i] = ToVector3(vv[i]);
+    vcache[vertices[i]] = vv[i].GetValueNoDup();
+  }
+  JSValue o = v.GetValueNoDup();  // JS_DupValue in ToJSValue
+  return JSPolygon(vertices, o, ToPlane(v[a.plane]));
+}
+
+inline void ToPolygons(ValueHolder&& v, std::vector<JSPolygon>& polygons) {
+  uint32_t sz = v.Length();
+  for (uint32_t i = 0; i < sz; i++) {
+    polygons.push_back(ToPolygon(v[i]));
+  }
+}
+
+inline void ToJSArray(const std::vector<JSPolygon>& polygons, ValueHolder&& v,
+                      std::unordered_map<geom::Vector3, JSValue>& vcache,
+                      bool withPlane = false) {
+  uint32_t offset = v.Length();
+  for (uint32_t i = 0; i < polygons.size(); i++) {
+    v.Set(i + offset, ToJSValue(v.ctx, polygons[i], vcache, withPlane));
+  }
+}
+
+// options: epsilon or {epsilon, heuristic: "first" | "sample", samples,
+// threads, parallelThreshold, precision: "double" | "float"}
+// float32 is set if precision is "float". Returns false (with a TypeError) if
+// heuristic is unknown.
+inline bool ToBuildOptions(ValueHolder&& v, geom::BSPBuildOptions& opts,
+                           double& eps, bool* float32 = nullptr) {
+  eps = DEFAULT_EPSILON;
+  if (!v.IsObject()) {
+    if (!v.IsUndefined()) {
+      eps = v.To<double>();
+    }
+    return true;
+  }
+  if (float32) {
+    auto precision = v["precision"];
+    *float32 = !precision.IsUndefined() &&
+               precision.To<std::string>() == "float";
+  }
+  auto heuristic = v["heuristic"];
+  if (!heuristic.IsUndefined()) {
+    std::string name = heuristic.To<std::string>();
+    if (name == "first") {
+      opts.heuristic = geom::BSPBuildOptions::FIRST;
+    } else if (name == "sample") {
+      opts.heuristic = geom::BSPBuildOptions::SAMPLE;
+    } else {
+      JS_ThrowTypeError(v.ctx, "unknown heuristic: %s", name.c_str());
+      return false;
+    }
+  }
+  auto samples = v["samples"];
+  if (!samples.IsUndefined()) {
+    opts.samples = samples.To<int32_t>();
+  }
+  auto threads = v["threads"];
+  if (!threads.IsUndefined()) {
+    opts.threads = threads.To<uint32_t>();
+  }
+  auto threshold = v["parallelThreshold"];
+  if (!threshold.IsUndefined()) {
+    opts.parallelThreshold = threshold.To<uint32_t>();
+  }
+  auto epsilon = v["epsilon"];
+  if (!epsilon.IsUndefined()) {
+    eps = epsilon.To<double>();
+  }
+  return true;
+}
+
+// Polygon soup: {positions: Float64Array | Float32Array, offsets: Uint32Array}.
+// Polygon i has the vertices [offsets[i], offsets[i + 1]) so offsets has one
+// more element than the number of polygons. opaque is the polygon index.
+typedef geom::Polygon<double, uint32_t> SoupPolygon;
+
+template <typename T>
+inline bool ReadPolygonSoup(const T* positions, size_t length,
+                            const uint32_t* offsets, size_t count,
+                            std::vector<SoupPolygon>& polygons) {
+  size_t vcount = length / 3;
+  polygons.reserve(polygons.size() + count);
+  for (size_t i = 0; i + 1 < count; i++) {
+    uint32_t start = offsets[i], end = offsets[i + 1];
+    if (end < start || end > vcount) {
+      return false;
+    }
+    if (end - start < 3) {
+      continue;
+    }
+    SoupPolygon::TVertices vertices(end - start);
+    for (uint32_t k = 0; k < end - start; k++) {
+      const T* p = positions + (size_t)(start + k) * 3;
+      vertices[k] = geom::Vector3(p[0], p[1], p[2]);
+    }
+    // the first three points may be collinear.
+    geom::Plane plane =
+        geom::Plane::fromPolygon(vertices.data(), vertices.size());
+    if (plane.isValid()) {
+      polygons.emplace_back(std::move(vertices), (uint32_t)i, plane);
+    }
+  }
+  return true;
+}
+
+// Degenerate polygons are dropped. Returns false if v is not a valid soup.
+// float32 is set if positions is a Float32Array.
+inline bool ToPolygonSoup(ValueHolder&& v, std::vector<SoupPolygon>& polygons,
+                          bool* float32 = nullptr) {
+  if (!v.IsObject() || v.IsArray()) {
+    return false;
+  }
+  ValueHolder positions = v["positions"];
+  ValueHolder offsets = v["offsets"];
+  size_t count, length;
+  uint32_t* o =
+      GetTypedArrayData<uint32_t>(v.ctx, offsets.GetValueNoDup(), &count);
+  if (!o) {
+    return false;
+  }
+  if (double* p = GetTypedArrayData<double>(v.ctx, positions.GetValueNoDup(),
+                                            &length)) {
+    if (float32) *float32 = false;
+    return ReadPolygonSoup(p, length, o, count, polygons);
+  }
+  if (float* p = GetTypedArrayData<float>(v.ctx, positions.GetValueNoDup(),
+                                          &length)) {
+    if (float32) *float32 = true;
+    return ReadPolygonSoup(p, length, o, count, polygons);
+  }
+  return false;
+}
+
+// returns {positions, offsets, sources}. sources[i] is the index of the input
+// polygon which the polygon i came from.
+template <typename T>
+inline JSValue ToJSPolygonSoup(JSContext* ctx,
+                               const std::vector<SoupPolygon>& polygons) {
+  std::vector<T> positions;
+  std::vector<uint32_t> offsets{0};
+  std::vector<uint32_t> sources;
+  offsets.reserve(polygons.size() + 1);
+  sources.reserve(polygons.size());
+  for (const auto& p : polygons) {
+    for (const auto& v : p.vertices) {
+      positions.push_back((T)v.x);
+      positions.push_back((T)v.y);
+      positions.push_back((T)v.z);
+    }
+    offsets.push_back((uint32_t)(positions.size() / 3));
+    sources.push_back(p.opaque);
+  }
+  ValueHolder obj(ctx);
+  obj.Set("positions", NewTypedArray(ctx, positions.data(), positions.size()));
+  obj.Set("offsets", NewTypedArray(ctx, offsets.data(), offsets.size()));
+  obj.Set("sources", NewTypedArray(ctx, sources.data(), sources.size()));
+  return unwrap(std::move(obj));
+}
+
+inline JSValue ToJSPolygonSoup(JSContext* ctx,
+                               const std::vector<SoupPolygon>& polygons,
+                               bool float32) {
+  return float32 ? ToJSPolygonSoup<float>(ctx, polygons)
+                 : ToJSPolygonSoup<double>(ctx, polygons);
+}
@@ -0,0 +1,252 @@
+#include <type_traits>
+#include <vector>
+
+#include "JSGeometry.h"
+#include "geometry.h"
+#include "geometry_simd.h"
+#include "qjsutils.h"
+#include "weld.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// Geometry
+//---------------------------------------------------------------------------------------------------------------------
+
+// Calls f(data, length) if v is a Float32Array or a Float64Array.
+template <typename F>
+static bool VisitFloatArray(JSContext* ctx, JSValueConst v, F&& f) {
+  size_t length;
+  if (float* p = GetTypedArrayData<float>(ctx, v, &length)) {
+    f(p, length);
+    return true;
+  }
+  if (double* p = GetTypedArrayData<double>(ctx, v, &length)) {
+    f(p, length);
+    return true;
+  }
+  return false;
+}
+
+// v: Matrix4, typed array or array of 16 numbers.
+static bool ToMatrix4(JSContext* ctx, JSValueConst v, geom::Matrix4& m) {
+  bool ok = false;
+  if (VisitFloatArray(ctx, v, [&](auto* p, size_t length) {
+        if (length >= 16) {
+          for (int i = 0; i < 16; i++) {
+            m[i] = p[i];
+          }
+          ok = true;
+        }
+      })) {
+    return ok;
+  }
+  ValueHolder a(ctx, v, true);
+  if (!a.IsObject()) {
+    return false;
+  }
+  if (!a.IsArray()) {
+    ValueHolder mat = a["m"];
+    return mat.IsObject() && ToMatrix4(ctx, mat.GetValueNoDup(), m);
+  }
+  if (a.Length() < 16) {
+    return false;
+  }
+  for (uint32_t i = 0; i < 16; i++) {
+    m[i] = a[i].To<double>();
+  }
+  return true;
+}
+
+static geom::Quaternion ToQuaternion(JSContext* ctx, JSValueConst v) {
+  double xyz[3];
+  get_xyz(ctx, v, xyz);
+  JSValue w = JS_GetProperty(ctx, v, atoms(ctx).w.atom);
+  geom::Quaternion q{xyz[0], xyz[1], xyz[2], to_float64(ctx, w)};
+  JS_FreeValue(ctx, w);
+  return q;
+}
+
+// Calls f(src, dst, count) to write count [x, y, z] points of positions to out.
+// Returns out, or a new array of the same type as positions if out is
+// undefined. out can be positions itself.
+template <typename F>
+static JSValue MapPoints(JSContext* ctx, JSValueConst positions,
+                         JSValueConst out, F&& f) {
+  JSValue ret = JS_UNDEFINED;
+  bool ok = VisitFloatArray(ctx, positions, [&](auto* src, size_t length) {
+    typedef std::remove_pointer_t<decltype(src)> T;
+    size_t outLength = 0;
+    T* dst;
+    if (JS_IsUndefined(out)) {
+      ret = NewTypedArray(ctx, src, length);
+      dst = GetTypedArrayData<T>(ctx, ret, &outLength);
+    } else {
+      ret = JS_DupValue(ctx, out);
+      dst = GetTypedArrayData<T>(ctx, out, &outLength);
+    }
+    if (!dst || outLength < length) {
+      JS_FreeValue(ctx, ret);
+      JS_ThrowTypeError(ctx, "output must be a %s of the same length",
+                        typed_array_traits<T>::name);
+      ret = JS_EXCEPTION;
+      return;
+    }
+    f(src, dst, length / 3);
+  });
+  if (!ok) {
+    JS_ThrowTypeError(ctx, "Float32Array or Float64Array required");
+    return JS_EXCEPTION;
+  }
+  return ret;
+}
+
+// (a: Matrix4Like, b: Matrix4Like, out: Float32Array | Float64Array) => out
+static JSValue MultiplyMatrix(JSContext* ctx, JSValueConst this_val, int argc,
+                              JSValueConst* argv) {
+  geom::Matrix4 a, b;
+  if (argc < 3 || !ToMatrix4(ctx, argv[0], a) || !ToMatrix4(ctx, argv[1], b)) {
+    JS_ThrowTypeError(ctx, "matrix required");
+    return JS_EXCEPTION;
+  }
+  geom::Matrix4 r = a * b;
+  bool ok = false;
+  VisitFloatArray(ctx, argv[2], [&](auto* p, size_t length) {
+    if (length >= 16) {
+      for (int i = 0; i < 16; i++) {
+        p[i] = (std::remove_pointer_t<decltype(p)>)r[i];
+      }
+      ok = true;
+    }
+  });
+  if (!ok) {
+    JS_ThrowTypeError(ctx, "Float32Array or Float64Array required");
+    return JS_EXCEPTION;
+  }
+  return JS_DupValue(ctx, argv[2]);
+}
+
+// (m: Matrix4Like, positions: Float32Array | Float64Array, out?) => out
+static JSValue TransformPoints(JSContext* ctx, JSValueConst this_val, int argc,
+                               JSValueConst* argv) {
+  geom::Matrix4 m;
+  if (argc < 2 || !ToMatrix4(ctx, argv[0], m)) {
+    JS_ThrowTypeError(ctx, "matrix required");
+    return JS_EXCEPTION;
+  }
+  return MapPoints(ctx, argv[1], argc > 2 ? argv[2] : JS_UNDEFINED,
+                   [&](auto* src, auto* dst, size_t count) {
+                     geom::simd::transformPoints(m, src, dst, count);
+                   });
+}
+
+// (q: {x, y, z, w}, positions: Float32Array | Float64Array, out?) => out
+static JSValue RotatePoints(JSContext* ctx, JSValueConst this_val, int argc,
+                            JSValueConst* argv) {
+  if (argc < 2 || !JS_IsObject(argv[0])) {
+    JS_ThrowTypeError(ctx, "quaternion required");
+    return JS_EXCEPTION;
+  }
+  geom::Quaternion q = ToQuaternion(ctx, argv[0]);
+  return MapPoints(ctx, argv[1], argc > 2 ? argv[2] : JS_UNDEFINED,
+                   [&](auto* src, auto* dst, size_t count) {
+                     typedef std::remove_pointer_t<decltype(dst)> T;
+                     for (size_t i = 0; i < count * 3; i += 3) {
+                       geom::Vector3 p = q.applyTo(
+                           geom::Vector3(src[i], src[i + 1], src[i + 2]));
+                       dst[i] = (T)p.x;
+                       dst[i + 1] = (T)p.y;
+                       dst[i + 2] = (T)p.z;
+                     }
+                   });
+}
+
+// (plane: {normal, w}, positions: Float32Array | Float64Array) => Float64Array
+static JSValue SignedDistances(JSContext* ctx, JSValueConst this_val, int argc,
+                               JSValueConst* argv) {
+  if (argc < 2 || !JS_IsObject(argv[0])) {
+    JS_ThrowTypeError(ctx, "plane required");
+    return JS_EXCEPTION;
+  }
+  geom::Plane plane = ToPlane(ValueHolder(ctx, argv[0], true));
+  std::vector<double> result;
+  if (!VisitFloatArray(ctx, argv[1], [&](auto* p, size_t length) {
+        result.resize(length / 3);
+        geom::simd::signedDistances(plane, p, result.data(), result.size());
+      })) {
+    JS_ThrowTypeError(ctx, "Float32Array or Float64Array required");
+    return JS_EXCEPTION;
+  }
+  return NewTypedArray(ctx, result.data(), result.size());
+}
+
+// (positions: Float32Array | Float64Array | {positions}, epsilon = 0) =>
+//     {positions, indices: Uint32Array}
+// Merges vertices within epsilon. indices[i] is the index of the welded vertex
+// of the input vertex i, and positions has the same type as the input.
+static JSValue WeldVertices(JSContext* ctx, JSValueConst this_val, int argc,
+                            JSValueConst* argv) {
+  if (argc < 1) {
+    JS_ThrowTypeError(ctx, "positions required");
+    return JS_EXCEPTION;
+  }
+  double eps = argc > 1 && !JS_IsUndefined(argv[1])
+                   ? to_float64(ctx, argv[1])
+                   : 0;
+  ValueHolder ret(ctx);
+  auto weld = [&](auto* p, size_t length) {
+    std::vector<uint32_t> remap;
+    auto welded = geom::weldVertices(p, length / 3, eps, remap);
+    ret.Set("positions", NewTypedArray(ctx, welded.data(), welded.size()));
+    ret.Set("indices", NewTypedArray(ctx, remap.data(), remap.size()));
+  };
+  if (!VisitFloatArray(ctx, argv[0], weld) &&
+      (!JS_IsObject(argv[0]) ||
+       !VisitFloatArray(
+           ctx, ValueHolder(ctx, argv[0], true)["positions"].GetValueNoDup(),
+           weld))) {
+    JS_ThrowTypeError(ctx, "Float32Array or Float64Array required");
+    return JS_EXCEPTION;
+  }
+  return unwrap(std::move(ret));
+}
+
+// (level?: "scalar" | "sse2" | "avx2") => string
+// Lowers the SIMD level of the batch functions. Returns the current level.
+static JSValue SimdLevel(JSContext* ctx, JSValueConst this_val, int argc,
+                         JSValueConst* argv) {
+  if (argc > 0 && !JS_IsUndefined(argv[0])) {
+    std::string name = convert_jsvalue<std::string>(ctx, argv[0]);
+    geom::simd::Level level = geom::simd::Level::SCALAR;
+    for (auto l : {geom::simd::Level::SSE2, geom::simd::Level::AVX2}) {
+      if (name == geom::simd::levelName(l)) {
+        level = l;
+      }
+    }
+    geom::simd::setLevel(level);
+  }
+  return to_jsvalue(ctx, geom::simd::levelName(geom::simd::activeLevel()));
+}
+
+const JSCFunctionListEntry geometry_funcs[] = {
+    function_entry("multiplyMatrix", 3, MultiplyMatrix),
+    function_entry("transformPoints", 3, TransformPoints),
+    function_entry("rotatePoints", 3, RotatePoints),
+    function_entry("signedDistances", 2, SignedDistances),
+    function_entry("weldVertices", 2, WeldVertices),
+    function_entry("simdLevel", 1, SimdLevel),
+};
+
+static int ModuleInit(JSContext* ctx, JSModuleDef* m) {
+  return JS_SetModuleExportList(ctx, m, geometry_funcs,
+                                (int)std::size(geometry_funcs));
+}
+
+JSModuleDef* InitGeometryModule(JSContext* ctx) {
+  JSModuleDef* m;
+  m = JS_NewCModule(ctx, "geometry", ModuleInit);
+  if (!m) {
+    return NULL;
+  }
+  JS_AddModuleExportList(ctx, m, geometry_funcs,
+                         (int)std::size(geometry_funcs));
+  return m;
+}
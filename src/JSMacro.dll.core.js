@@ -1,5 +1,6 @@
 import * as _dialog from "mqwidget";
 import * as fs from "fs";
+import * as _geometry from "geometry";
 
 // geometry
 class Vector3 {
@@ -69,6 +70,7 @@ class Quaternion {
 			iz * w + iw * - z + ix * - y - iy * - x
 		);
 	}
+	applyToArray(positions, out) { return _geometry.rotatePoints(this, positions, out); }
 	clone() { return new Quaternion(this.x, this.y, this.z); }
 	toString() { return "(" + this.x + " " + this.y + " " + this.z + " " + this.w + ")"; }
 	static multiply(a, b) {
@@ -124,6 +126,7 @@ class Matrix4 {
 				m[8] * p.x + m[9] * p.y + m[10] * p.z + m[11] + m[14]);
 		}
 	}
+	applyToArray(positions, out) { return _geometry.transformPoints(this.m, positions, out); }
 	transformV(p) { return this.applyTo(p); }
 	transform(p) { return this.applyTo(p); }
 	toString() {
@@ -189,6 +192,7 @@ class Plane {
 	get normal() { return this._normal; }
 	get w() { return this._w; }
 	flipped() { return new Plane(this._normal.negated(), -this._w); }
+	signedDistances(positions) { return _geometry.signedDistances(this, positions); }
 	toString() { return "Plane(" + this._normal.toString() + "," + this + ")"; }
 }
 
@@ -311,13 +315,14 @@ MQDocument.prototype.addEventListener = function (name, f) {
 	listeners[name].push([this, f]);
 };
 
+const nativeApplyTransform = MQObject.prototype.applyTransform;
 MQObject.prototype.applyTransform = function (tr) {
 	const length = this.verts.length;
 	if (typeof tr === "function") {
 		for (let i = 0; i < length; i++) {
 			this.verts[i] = tr(this.verts[i]);
 		}
-	} else {
+	} else if (!nativeApplyTransform.call(this, tr)) {
 		for (let i = 0; i < length; i++) {
 			this.verts[i] = tr.applyTo(this.verts[i]);
 		}
@@ -18,6 +18,7 @@
 #include "MQBasePlugin.h"
 #include "MQSetting.h"
 #include "Utils.h"
+#include "parallel.h"
 #include "preference.h"
 
 #define PLUGIN_VERSION "v0.3.1"
@@ -30,6 +31,9 @@ JSModuleDef *InitMQWidgetModule(JSContext *ctx);
 JSModuleDef *InitFsModule(JSContext *ctx);
 JSModuleDef *InitChildProcessModule(JSContext *ctx);
 JSModuleDef *InitBSPTreeModule(JSContext *ctx);
+JSModuleDef *InitCSGModule(JSContext *ctx);
+JSModuleDef *InitBVHModule(JSContext *ctx);
+JSModuleDef *InitGeometryModule(JSContext *ctx);
 void InstallMQDocument(JSContext *ctx, MQDocument doc,
                        std::map<std::string, std::string> *keyValue = nullptr);
 void CloseAllWindow(JSContext *ctx);
@@ -352,7 +356,9 @@ BOOL JSMacroPlugin::Initialize() {
 //---------------------------------------------------------------------------------------------------------------------
 void JSMacroPlugin::Exit() {
   DisposeJsContext();
+  FreeAtomTable(runtime);
   JS_FreeRuntime(runtime);
+  ThreadPool::instance().shutdown();
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -647,6 +653,9 @@ JsContext *JSMacroPlugin::GetJsContext(MQDocument doc,
     InitChildProcessModule(ctx);
     InitFsModule(ctx);
     InitBSPTreeModule(ctx);
+    InitCSGModule(ctx);
+    InitBVHModule(ctx);
+    InitGeometryModule(ctx);
     InitMQWidgetModule(ctx);
     InstallMQDocument(ctx, doc, &pluginKeyValue);
 
@@ -1,36 +1,73 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
 #include <vector>
 
 #include "geometry.h"
+#include "parallel.h"
+#include "small_vector.h"
 namespace geom {
 
 struct empty_t {};
 
+// Most polygons are triangles or quads (or their fragments), so vertices are
+// stored inline up to this count.
+const size_t POLYGON_INLINE_VERTICES = 8;
+
 template <typename T, typename O = empty_t>
 class Polygon {
   using TPlane = PlaneT<T>;
   using TVertex = Vector3T<T>;
 
  public:
-  std::vector<TVertex> vertices;
+  using TVertices = SmallVector<TVertex, POLYGON_INLINE_VERTICES>;
+
+  TVertices vertices;
   TPlane plane;
   [[no_unique_address]] O opaque;
 
-  Polygon(const std::vector<TVertex> &v, const O &o, const TPlane &p)
-      : vertices(v), opaque(o), plane(p) {}
+  Polygon(const TVertices &v, const O &o, const TPlane &p)
+      : vertices(v), plane(p), opaque(o) {}
 
-  Polygon(const std::vector<TVertex> &v, const O &o = O())
-      : vertices(v), opaque(o) {
+  Polygon(TVertices &&v, const O &o, const TPlane &p)
+      : vertices(std::move(v)), plane(p), opaque(o) {}
+
+  Polygon(const TVertices &v, const O &o = O()) : vertices(v), opaque(o) {
     plane = TPlane::fromPoints(v[0], v[1], v[2]);
   }
 
+  void flip() {
+    std::reverse(vertices.begin(), vertices.end());
+    plane = plane.flipped();
+  }
+
+  // converts to another precision. the plane is converted, not recomputed.
+  template <typename U>
+  Polygon<U, O> cast() const {
+    typename Polygon<U, O>::TVertices v(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+      v[i] = vertices[i].template cast<U>();
+    }
+    return Polygon<U, O>(std::move(v), opaque, plane.template cast<U>());
+  }
+
+  // returns TPlane::FRONT, BACK, COPLANAR or FRONT | BACK (spanning).
+  int classify(const TPlane &splane, T eps = 0) const {
+    int type_sum = 0;
+    for (const auto &v : vertices) {
+      type_sum |= splane.classifyPoint(v, eps);
+    }
+    return type_sum;
+  }
+
   // split this polygon by the plane.
   int split(const TPlane &splane, std::vector<Polygon<T, O>> &coplanar_front,
             std::vector<Polygon<T, O>> &coplanar_back,
             std::vector<Polygon<T, O>> &front, std::vector<Polygon<T, O>> &back,
             T eps = 0) const {
     int type_sum = 0;
-    std::vector<int> types(vertices.size());
+    SmallVector<int, POLYGON_INLINE_VERTICES> types(vertices.size());
     for (size_t i = 0; i < vertices.size(); i++) {
       types[i] = splane.classifyPoint(vertices[i], eps);
       type_sum |= types[i];
@@ -47,7 +84,7 @@ class Polygon {
         back.push_back(*this);
         break;
       case TPlane::FRONT | TPlane::BACK:
-        std::vector<TVertex> f, b;
+        TVertices f, b;
         size_t n = vertices.size();
         for (size_t i = 0; i < n; i++) {
           size_t j = (i + 1) % n;
@@ -61,8 +98,8 @@ class Polygon {
             b.push_back(v);
           }
         }
-        if (f.size() >= 3) front.push_back(Polygon(f, opaque, plane));
-        if (b.size() >= 3) back.push_back(Polygon(b, opaque, plane));
+        if (f.size() >= 3) front.emplace_back(std::move(f), opaque, plane);
+        if (b.size() >= 3) back.emplace_back(std::move(b), opaque, plane);
         break;
     }
     return type_sum;
@@ -76,51 +113,123 @@ static std::ostream &operator<<(std::ostream &ost, const Polygon<T, O> &p) {
   return ost;
 }
 
+template <typename U, typename T, typename O>
+std::vector<Polygon<U, O>> castPolygons(
+    const std::vector<Polygon<T, O>> &polygons) {
+  std::vector<Polygon<U, O>> result;
+  result.reserve(polygons.size());
+  for (const auto &p : polygons) {
+    result.push_back(p.template cast<U>());
+  }
+  return result;
+}
+
+struct BSPBuildOptions {
+  enum Heuristic {
+    FIRST,   // use the plane of the first polygon.
+    SAMPLE,  // best of sampled candidates by split count and balance.
+  };
+  Heuristic heuristic = FIRST;
+  int samples = 8;  // number of candidate planes for SAMPLE.
+  unsigned int threads = 1;  // 0: all cores.
+  // Subtrees with fewer polygons are built as a single task in parallel mode.
+  size_t parallelThreshold = 1024;
+};
+
+// BSP tree. All nodes are stored in a flat array and children are referenced
+// by index, so the whole tree is released at once.
 template <typename TPlane>
 class BSPNodeT {
-  BSPNodeT<TPlane> *front = nullptr;
-  BSPNodeT<TPlane> *back = nullptr;
-  TPlane plane;
+  static const int32_t NONE = -1;
+  struct Node {
+    TPlane plane;
+    int32_t front = NONE;
+    int32_t back = NONE;
+  };
+  std::vector<Node> nodes{1};  // nodes[0] is the root node.
 
  public:
   using TElement = TPlane::TElement;
 
   BSPNodeT() {}
   template <typename TPolygon>
-  BSPNodeT(const std::vector<TPolygon> &polygons, TElement eps = 0) {
-    build(polygons, eps);
+  BSPNodeT(const std::vector<TPolygon> &polygons, TElement eps = 0,
+           const BSPBuildOptions &opts = BSPBuildOptions()) {
+    build(polygons, eps, opts);
   }
 
   template <typename TPolygon>
-  void build(const std::vector<TPolygon> &polygons, TElement eps = 0) {
-    // TODO: build() multiple times.
-    if (!plane.isValid() && polygons.size() > 0) {
-      plane = polygons[0].plane;
+  void build(const std::vector<TPolygon> &polygons, TElement eps = 0,
+             const BSPBuildOptions &opts = BSPBuildOptions()) {
+    nodes.assign(1, Node());
+    nodes.reserve(polygons.size());
+    if (opts.threads != 1 && polygons.size() >= opts.parallelThreshold) {
+      buildParallel(polygons, eps, opts);
+      return;
     }
-    std::vector<TPolygon> f, b, ignore;
-    for (const auto &p : polygons) {
-      p.split(plane, ignore, ignore, f, b, eps);
-      ignore.clear();
+    // Depth-first with an explicit stack. The back child is pushed first so
+    // that the front subtree is built first. Both children are allocated
+    // before either subtree, so the tree has the same shape as a recursive
+    // build but the nodes are numbered differently.
+    std::vector<BuildTask<TPolygon>> stack;
+    buildNode(0, polygons, eps, opts, stack);
+    while (!stack.empty()) {
+      BuildTask<TPolygon> task = std::move(stack.back());
+      stack.pop_back();
+      buildNode(task.node, task.polygons, eps, opts, stack);
     }
-    if (f.size() > 0) front = new BSPNodeT<TPlane>(f, eps);
-    if (b.size() > 0) back = new BSPNodeT<TPlane>(b, eps);
   }
 
+  // depth of the deepest leaf.
+  size_t depth() const {
+    size_t result = 0;
+    std::vector<std::pair<int32_t, size_t>> stack{{0, 1}};
+    while (!stack.empty()) {
+      auto [n, d] = stack.back();
+      stack.pop_back();
+      result = std::max(result, d);
+      if (nodes[n].front != NONE) stack.push_back({nodes[n].front, d + 1});
+      if (nodes[n].back != NONE) stack.push_back({nodes[n].back, d + 1});
+    }
+    return result;
+  }
+
+  size_t size() const { return nodes.size(); }
+
   // TODO: output_iterator<TPolygon>
   template <typename TPolygon>
   void splitPolygons(const std::vector<TPolygon> &polygons,
                      std::vector<TPolygon> &inner, std::vector<TPolygon> &outer,
                      TElement eps = 0) const {
-    std::vector<TPolygon> tmp_f, tmp_b;
-    std::vector<TPolygon> &f = front ? tmp_f : outer, &b = back ? tmp_b : inner;
-    for (const auto &p : polygons) {
-      p.split(plane, f, b, f, b, eps);
-    }
-    if (front && f.size() > 0) {
-      front->splitPolygons(f, inner, outer, eps);
+    splitPolygons(0, polygons, inner, outer, eps);
+  }
+
+  // Splits batches of polygons on up to `threads` threads. The results contain
+  // the same polygons as the serial version, grouped by batch in input order.
+  template <typename TPolygon>
+  void splitPolygons(const std::vector<TPolygon> &polygons,
+                     std::vector<TPolygon> &inner, std::vector<TPolygon> &outer,
+                     TElement eps, unsigned int threads) const {
+    const size_t BATCH_SIZE = 256;
+    if (threads == 1 || polygons.size() <= BATCH_SIZE) {
+      splitPolygons(0, polygons, inner, outer, eps);
+      return;
     }
-    if (back && b.size() > 0) {
-      back->splitPolygons(b, inner, outer, eps);
+    size_t batches = (polygons.size() + BATCH_SIZE - 1) / BATCH_SIZE;
+    std::vector<std::vector<TPolygon>> bi(batches), bo(batches);
+    parallel_for(
+        batches,
+        [&](size_t c) {
+          auto begin = polygons.begin() + c * BATCH_SIZE;
+          auto end = polygons.begin() +
+                     std::min(polygons.size(), (c + 1) * BATCH_SIZE);
+          splitPolygons(0, std::vector<TPolygon>(begin, end), bi[c], bo[c],
+                        eps);
+        },
+        threads);
+    for (size_t c = 0; c < batches; c++) {
+      std::move(bi[c].begin(), bi[c].end(), std::back_inserter(inner));
+      std::move(bo[c].begin(), bo[c].end(), std::back_inserter(outer));
     }
   }
 
@@ -130,54 +239,321 @@ class BSPNodeT {
                TElement eps = 0, TElement min = 0,
                TElement max = std::numeric_limits<TElement>::has_infinity
                                   ? std::numeric_limits<TElement>::infinity()
-                                  : std::numeric_limits<TElement>::max()) {
-    bool backside =
-        plane.signedDistanceTo(ray.origin + ray.direction * min) < 0;
-    if (backside && back == nullptr) {
-      intersection = ray.origin + ray.direction * min;
-      return true;
-    }
-    auto t = ray.distanceTo(plane);
-    auto near = backside ? back : front;
-    if (t < min || t > max) {
-      if (near) {
-        return near->raycast(ray, intersection, eps, min, max);
+                                  : std::numeric_limits<TElement>::max())
+      const {
+    TElement distance;
+    return raycast(0, ray, intersection, distance, eps, min, max);
+  }
+
+  // returns the ray parameter of the nearest intersection, or -1 if the ray
+  // does not hit.
+  TElement raycastDistance(const RayT<TElement> &ray, TElement eps = 0) const {
+    Vector3T<TElement> intersection;
+    TElement distance;
+    if (!raycast(0, ray, intersection, distance, eps, 0,
+                 std::numeric_limits<TElement>::has_infinity
+                     ? std::numeric_limits<TElement>::infinity()
+                     : std::numeric_limits<TElement>::max())) {
+      return -1;
+    }
+    return distance;
+  }
+
+  // returns TPlane::FRONT, BACK or COPLANAR
+  int classifyPoint(const Vector3T<TElement> &v, TElement eps = 0) const {
+    return classifyPoint(0, v, eps);
+  }
+
+ private:
+  template <typename TPolygon>
+  struct BuildTask {
+    int32_t node;
+    std::vector<TPolygon> polygons;
+  };
+
+  int32_t newNode() {
+    nodes.emplace_back();
+    return (int32_t)(nodes.size() - 1);
+  }
+
+  // Produces the same tree as the serial build. Large nodes are split on this
+  // thread (the polygons themselves in parallel) until the remaining subtrees
+  // are small enough, then the subtrees are built independently and grafted.
+  template <typename TPolygon>
+  void buildParallel(const std::vector<TPolygon> &polygons, TElement eps,
+                     const BSPBuildOptions &opts) {
+    std::vector<BuildTask<TPolygon>> stack, subtrees;
+    buildNode(0, polygons, eps, opts, stack, opts.threads);
+    while (!stack.empty()) {
+      BuildTask<TPolygon> task = std::move(stack.back());
+      stack.pop_back();
+      if (task.polygons.size() < opts.parallelThreshold) {
+        subtrees.push_back(std::move(task));
+      } else {
+        buildNode(task.node, task.polygons, eps, opts, stack, opts.threads);
       }
-    } else {
-      if (near && near->raycast(ray, intersection, eps, min, t - eps)) {
+    }
+
+    BSPBuildOptions serial = opts;
+    serial.threads = 1;
+    std::vector<BSPNodeT<TPlane>> built(subtrees.size());
+    parallel_for(
+        subtrees.size(),
+        [&](size_t i) { built[i].build(subtrees[i].polygons, eps, serial); },
+        opts.threads);
+    for (size_t i = 0; i < subtrees.size(); i++) {
+      graft(subtrees[i].node, built[i]);
+    }
+  }
+
+  // Replaces node n with the root of sub and appends the rest of its nodes.
+  void graft(int32_t n, const BSPNodeT<TPlane> &sub) {
+    int32_t base = (int32_t)nodes.size() - 1;
+    auto remap = [&](int32_t i) {
+      return i == NONE ? NONE : i == 0 ? n : base + i;
+    };
+    for (size_t i = 0; i < sub.nodes.size(); i++) {
+      const Node &s = sub.nodes[i];
+      Node node{s.plane, remap(s.front), remap(s.back)};
+      if (i == 0) {
+        nodes[n] = node;
+      } else {
+        nodes.push_back(node);
+      }
+    }
+  }
+
+  template <typename TPolygon>
+  static void splitAll(const TPlane &plane,
+                       const std::vector<TPolygon> &polygons, TElement eps,
+                       std::vector<TPolygon> &f, std::vector<TPolygon> &b,
+                       unsigned int threads) {
+    const size_t CHUNK_SIZE = 256;
+    if (threads == 1 || polygons.size() <= CHUNK_SIZE) {
+      std::vector<TPolygon> ignore;
+      for (const auto &p : polygons) {
+        p.split(plane, ignore, ignore, f, b, eps);
+        ignore.clear();
+      }
+      return;
+    }
+    // Results are concatenated in chunk order to keep the serial order.
+    size_t chunks = (polygons.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<std::vector<TPolygon>> cf(chunks), cb(chunks);
+    parallel_for(
+        chunks,
+        [&](size_t c) {
+          std::vector<TPolygon> ignore;
+          size_t end = std::min(polygons.size(), (c + 1) * CHUNK_SIZE);
+          for (size_t i = c * CHUNK_SIZE; i < end; i++) {
+            polygons[i].split(plane, ignore, ignore, cf[c], cb[c], eps);
+            ignore.clear();
+          }
+        },
+        threads);
+    for (size_t c = 0; c < chunks; c++) {
+      std::move(cf[c].begin(), cf[c].end(), std::back_inserter(f));
+      std::move(cb[c].begin(), cb[c].end(), std::back_inserter(b));
+    }
+  }
+
+  template <typename TPolygon>
+  void buildNode(int32_t n, const std::vector<TPolygon> &polygons,
+                 TElement eps, const BSPBuildOptions &opts,
+                 std::vector<BuildTask<TPolygon>> &stack,
+                 unsigned int threads = 1) {
+    if (!nodes[n].plane.isValid() && polygons.size() > 0) {
+      nodes[n].plane = selectPlane(polygons, eps, opts);
+    }
+    std::vector<TPolygon> f, b;
+    splitAll(nodes[n].plane, polygons, eps, f, b, threads);
+    if (f.size() > 0) {
+      nodes[n].front = newNode();
+    }
+    if (b.size() > 0) {
+      nodes[n].back = newNode();
+      stack.push_back({nodes[n].back, std::move(b)});
+    }
+    if (f.size() > 0) {
+      stack.push_back({nodes[n].front, std::move(f)});
+    }
+  }
+
+  // Scores evenly spaced candidate planes against (a subset of) the polygons.
+  // Each split counts as SPLIT_COST unbalanced polygons.
+  template <typename TPolygon>
+  static TPlane selectPlane(const std::vector<TPolygon> &polygons,
+                            TElement eps, const BSPBuildOptions &opts) {
+    const size_t SPLIT_COST = 8;
+    const size_t MAX_EVAL_POLYGONS = 256;
+    size_t n = polygons.size();
+    if (opts.heuristic == BSPBuildOptions::FIRST || opts.samples <= 1 ||
+        n < 3) {
+      return polygons[0].plane;
+    }
+    size_t samples = std::min(n, (size_t)opts.samples);
+    size_t eval_step = std::max<size_t>(1, n / MAX_EVAL_POLYGONS);
+    size_t best = 0, best_score = std::numeric_limits<size_t>::max();
+    for (size_t i = 0; i < samples; i++) {
+      size_t c = i * n / samples;
+      const TPlane &plane = polygons[c].plane;
+      if (!plane.isValid()) {
+        continue;
+      }
+      size_t front = 0, back = 0, split = 0;
+      for (size_t j = 0; j < n; j += eval_step) {
+        switch (polygons[j].classify(plane, eps)) {
+          case TPlane::FRONT:
+            front++;
+            break;
+          case TPlane::BACK:
+            back++;
+            break;
+          case TPlane::FRONT | TPlane::BACK:
+            split++;
+            break;
+        }
+      }
+      size_t score = split * SPLIT_COST +
+                     (front > back ? front - back : back - front);
+      if (score < best_score) {
+        best = c;
+        best_score = score;
+      }
+    }
+    return polygons[best].plane;
+  }
+
+  template <typename TPolygon>
+  void splitPolygons(int32_t root, const std::vector<TPolygon> &polygons,
+                     std::vector<TPolygon> &inner, std::vector<TPolygon> &outer,
+                     TElement eps) const {
+    std::vector<BuildTask<TPolygon>> stack;
+    splitNode(root, polygons, inner, outer, eps, stack);
+    while (!stack.empty()) {
+      BuildTask<TPolygon> task = std::move(stack.back());
+      stack.pop_back();
+      splitNode(task.node, task.polygons, inner, outer, eps, stack);
+    }
+  }
+
+  template <typename TPolygon>
+  void splitNode(int32_t n, const std::vector<TPolygon> &polygons,
+                 std::vector<TPolygon> &inner, std::vector<TPolygon> &outer,
+                 TElement eps, std::vector<BuildTask<TPolygon>> &stack) const {
+    const Node &node = nodes[n];
+    // The polygons may have another precision than the tree (e.g. double
+    // polygons and a float tree). They are split in their own precision.
+    typedef decltype(TPolygon::plane) TPolygonPlane;
+    const TPolygonPlane plane =
+        node.plane.template cast<typename TPolygonPlane::TElement>();
+    std::vector<TPolygon> tmp_f, tmp_b;
+    std::vector<TPolygon> &f = node.front != NONE ? tmp_f : outer,
+                          &b = node.back != NONE ? tmp_b : inner;
+    for (const auto &p : polygons) {
+      p.split(plane, f, b, f, b, eps);
+    }
+    if (node.back != NONE && b.size() > 0) {
+      stack.push_back({node.back, std::move(b)});
+    }
+    if (node.front != NONE && f.size() > 0) {
+      stack.push_back({node.front, std::move(f)});
+    }
+  }
+
+  bool raycast(int32_t root, const RayT<TElement> &ray,
+               Vector3T<TElement> &intersection, TElement &distance,
+               TElement eps, TElement min, TElement max) const {
+    // node == NONE is a pending hit at distance min.
+    struct RayTask {
+      int32_t node;
+      TElement min, max;
+    };
+    std::vector<RayTask> stack{{root, min, max}};
+    while (!stack.empty()) {
+      RayTask task = stack.back();
+      stack.pop_back();
+      if (task.node == NONE) {
+        intersection = ray.origin + ray.direction * task.min;
+        distance = task.min;
         return true;
       }
-      if (!backside && back == nullptr) {
-        intersection = ray.origin + ray.direction * t;
+      const Node &node = nodes[task.node];
+      bool backside = node.plane.signedDistanceTo(ray.origin +
+                                                  ray.direction * task.min) < 0;
+      if (backside && node.back == NONE) {
+        intersection = ray.origin + ray.direction * task.min;
+        distance = task.min;
         return true;
       }
-      auto far = backside ? front : back;
-      if (far) {
-        return far->raycast(ray, intersection, eps, t + eps, max);
+      auto t = ray.distanceTo(node.plane);
+      auto near = backside ? node.back : node.front;
+      if (t < task.min || t > task.max) {
+        if (near != NONE) {
+          stack.push_back({near, task.min, task.max});
+        }
+      } else {
+        auto far = backside ? node.front : node.back;
+        if (!backside && node.back == NONE) {
+          stack.push_back({NONE, t, t});
+        } else if (far != NONE) {
+          stack.push_back({far, t + eps, task.max});
+        }
+        if (near != NONE) {
+          stack.push_back({near, task.min, t - eps});
+        }
       }
     }
     return false;
   }
 
-  // returns TPlane::FRONT, BACK or COPLANAR
-  int classifyPoint(const Vector3T<TElement> &v, TElement eps = 0) {
-    int fb = plane.classifyPoint(v, eps);
-    if (fb == TPlane::BACK) {
-      return back ? back->classifyPoint(v, eps) : fb;
-    } else if (fb == TPlane::FRONT) {
-      return front ? front->classifyPoint(v, eps) : fb;
+  int classifyPoint(int32_t n, const Vector3T<TElement> &v,
+                    TElement eps) const {
+    // A point on the plane of a node is classified in both children. Such
+    // nodes are kept on the stack with the result of the front child (-1
+    // until it is known).
+    std::vector<std::pair<int32_t, int>> stack;
+    for (;;) {
+      int fb = nodes[n].plane.classifyPoint(v, eps);
+      while (fb != TPlane::COPLANAR) {
+        int32_t next = fb == TPlane::BACK ? nodes[n].back : nodes[n].front;
+        if (next == NONE) {
+          break;
+        }
+        n = next;
+        fb = nodes[n].plane.classifyPoint(v, eps);
+      }
+      if (fb == TPlane::COPLANAR) {
+        stack.push_back({n, -1});
+        if (nodes[n].front != NONE) {
+          n = nodes[n].front;
+          continue;
+        }
+        fb = TPlane::FRONT;
+      }
+      // fb is the result of the subtree. Combine it with the pending nodes.
+      for (;;) {
+        if (stack.empty()) {
+          return fb;
+        }
+        auto &[m, f] = stack.back();
+        if (f < 0) {
+          f = fb;
+          if (nodes[m].back != NONE) {
+            n = nodes[m].back;
+            break;
+          }
+          fb = TPlane::BACK;
+        }
+        fb = f == fb ? f : TPlane::COPLANAR;
+        stack.pop_back();
+      }
     }
-    int f = front ? front->classifyPoint(v, eps) : TPlane::FRONT;
-    int b = back ? back->classifyPoint(v, eps) : TPlane::BACK;
-    return f == b ? f : fb;
-  }
-
-  ~BSPNodeT() {
-    if (front) delete front;
-    if (back) delete back;
   }
 };
 
 typedef BSPNodeT<Plane> BSPNode;
+// single precision tree. half the memory of BSPNode.
+typedef BSPNodeT<PlaneT<float>> BSPNodeF;
 
 }  // namespace geom
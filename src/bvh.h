@@ -0,0 +1,465 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "geometry.h"
+#include "small_vector.h"
+
+namespace geom {
+
+template <typename T>
+static T component(const Vector3T<T> &v, int axis) {
+  return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+template <typename T>
+struct AABBT {
+  Vector3T<T> min = {std::numeric_limits<T>::max(),
+                     std::numeric_limits<T>::max(),
+                     std::numeric_limits<T>::max()};
+  Vector3T<T> max = {std::numeric_limits<T>::lowest(),
+                     std::numeric_limits<T>::lowest(),
+                     std::numeric_limits<T>::lowest()};
+
+  bool empty() const { return min.x > max.x; }
+  void extend(const Vector3T<T> &p) {
+    min = {std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+    max = {std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+  }
+  void extend(const AABBT<T> &b) {
+    min = {std::min(min.x, b.min.x), std::min(min.y, b.min.y),
+           std::min(min.z, b.min.z)};
+    max = {std::max(max.x, b.max.x), std::max(max.y, b.max.y),
+           std::max(max.z, b.max.z)};
+  }
+  // half of the surface area.
+  T halfArea() const {
+    if (empty()) {
+      return 0;
+    }
+    auto d = max - min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+  }
+  bool intersects(const AABBT<T> &b) const {
+    return min.x <= b.max.x && max.x >= b.min.x && min.y <= b.max.y &&
+           max.y >= b.min.y && min.z <= b.max.z && max.z >= b.min.z;
+  }
+  T distanceSqr(const Vector3T<T> &p) const {
+    T dx = std::max({min.x - p.x, (T)0, p.x - max.x});
+    T dy = std::max({min.y - p.y, (T)0, p.y - max.y});
+    T dz = std::max({min.z - p.z, (T)0, p.z - max.z});
+    return dx * dx + dy * dy + dz * dz;
+  }
+  // Slab test. invDir is 1 / ray.direction. entry is set to the ray parameter
+  // where the ray enters the box (clamped to tmin).
+  bool intersects(const RayT<T> &ray, const Vector3T<T> &invDir, T tmin,
+                  T tmax, T &entry) const {
+    for (int axis = 0; axis < 3; axis++) {
+      T o = component(ray.origin, axis), inv = component(invDir, axis);
+      T t0 = (component(min, axis) - o) * inv;
+      T t1 = (component(max, axis) - o) * inv;
+      if (t0 > t1) std::swap(t0, t1);
+      // NaN (0 * inf) keeps the current range.
+      tmin = t0 > tmin ? t0 : tmin;
+      tmax = t1 < tmax ? t1 : tmax;
+      if (tmin > tmax) {
+        return false;
+      }
+    }
+    entry = tmin;
+    return true;
+  }
+};
+
+template <typename T>
+struct TriangleT {
+  Vector3T<T> a, b, c;
+
+  // not normalized.
+  Vector3T<T> normal() const { return (b - a).cross(c - a); }
+  Vector3T<T> centroid() const { return (a + b + c) / 3; }
+  AABBT<T> bounds() const {
+    AABBT<T> box;
+    box.extend(a);
+    box.extend(b);
+    box.extend(c);
+    return box;
+  }
+
+  // Moller-Trumbore. Both sides are hit. t is the ray parameter.
+  bool raycast(const RayT<T> &ray, T &t) const {
+    auto e1 = b - a, e2 = c - a;
+    auto p = ray.direction.cross(e2);
+    T det = e1.dot(p);
+    if (det == 0) {
+      return false;
+    }
+    T inv = 1 / det;
+    auto s = ray.origin - a;
+    T u = s.dot(p) * inv;
+    if (u < 0 || u > 1) {
+      return false;
+    }
+    auto q = s.cross(e1);
+    T v = ray.direction.dot(q) * inv;
+    if (v < 0 || u + v > 1) {
+      return false;
+    }
+    t = e2.dot(q) * inv;
+    return true;
+  }
+
+  // See Real-Time Collision Detection 5.1.5.
+  Vector3T<T> closestPoint(const Vector3T<T> &p) const {
+    auto ab = b - a, ac = c - a, ap = p - a;
+    T d1 = ab.dot(ap), d2 = ac.dot(ap);
+    if (d1 <= 0 && d2 <= 0) return a;
+    auto bp = p - b;
+    T d3 = ab.dot(bp), d4 = ac.dot(bp);
+    if (d3 >= 0 && d4 <= d3) return b;
+    T vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+    auto cp = p - c;
+    T d5 = ab.dot(cp), d6 = ac.dot(cp);
+    if (d6 >= 0 && d5 <= d6) return c;
+    T vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+    T va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+      return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+    T denom = 1 / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+  }
+
+  // Separating axis test. Triangles which are closer than eps to being
+  // separated (e.g. only touching) are treated as not intersecting.
+  bool intersects(const TriangleT<T> &o, T eps = 0) const {
+    const Vector3T<T> p[3] = {a, b, c}, q[3] = {o.a, o.b, o.c};
+    const Vector3T<T> ep[3] = {b - a, c - b, a - c};
+    const Vector3T<T> eq[3] = {o.b - o.a, o.c - o.b, o.a - o.c};
+    auto separated = [&](const Vector3T<T> &u, const Vector3T<T> &v) {
+      auto axis = u.cross(v);
+      T len = axis.length();
+      // skip axes from (nearly) parallel vectors.
+      if (!(len > std::sqrt(u.lengthSqr() * v.lengthSqr()) * 1e-12)) {
+        return false;
+      }
+      axis = axis / len;
+      T pmin = axis.dot(p[0]), pmax = pmin, qmin = axis.dot(q[0]), qmax = qmin;
+      for (int i = 1; i < 3; i++) {
+        T dp = axis.dot(p[i]), dq = axis.dot(q[i]);
+        pmin = std::min(pmin, dp);
+        pmax = std::max(pmax, dp);
+        qmin = std::min(qmin, dq);
+        qmax = std::max(qmax, dq);
+      }
+      return pmax < qmin + eps || qmax < pmin + eps;
+    };
+    auto np = ep[0].cross(ep[1]), nq = eq[0].cross(eq[1]);
+    if (separated(ep[0], ep[1]) || separated(eq[0], eq[1])) {
+      return false;
+    }
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        if (separated(ep[i], eq[j])) {
+          return false;
+        }
+      }
+    }
+    // in-plane axes for coplanar triangles.
+    for (int i = 0; i < 3; i++) {
+      if (separated(np, ep[i]) || separated(nq, eq[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+// Bounding volume hierarchy over triangles. Built with the binned surface area
+// heuristic. Nodes are stored in a flat array and the children of an interior
+// node are adjacent.
+template <typename T>
+class BVHT {
+ public:
+  using TVector = Vector3T<T>;
+  using TTriangle = TriangleT<T>;
+  using TAABB = AABBT<T>;
+
+ private:
+  static const int BINS = 16;
+  static const uint32_t MAX_LEAF_SIZE = 8;
+  static constexpr T TRAVERSAL_COST = 1;  // relative to a triangle test.
+
+  struct Node {
+    TAABB bounds;
+    uint32_t first = 0;  // first triangle, or left child if interior.
+    uint32_t count = 0;  // number of triangles. 0: interior node.
+  };
+  std::vector<Node> nodes;
+  std::vector<TTriangle> triangles;
+  std::vector<uint32_t> ids;  // index of the source triangle.
+
+ public:
+  BVHT() {}
+  BVHT(const std::vector<TTriangle> &src) { build(src); }
+
+  void build(const std::vector<TTriangle> &src) {
+    nodes.clear();
+    triangles.clear();
+    ids.resize(src.size());
+    if (src.empty()) {
+      return;
+    }
+    std::vector<TAABB> boxes(src.size());
+    std::vector<TVector> centroids(src.size());
+    for (size_t i = 0; i < src.size(); i++) {
+      ids[i] = (uint32_t)i;
+      boxes[i] = src[i].bounds();
+      centroids[i] = src[i].centroid();
+    }
+    nodes.reserve(src.size() / 2 + 1);
+    nodes.push_back(Node{TAABB(), 0, (uint32_t)src.size()});
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+      uint32_t n = stack.back();
+      stack.pop_back();
+      uint32_t first = nodes[n].first, count = nodes[n].count;
+      TAABB bounds, cbounds;
+      for (uint32_t k = first; k < first + count; k++) {
+        bounds.extend(boxes[ids[k]]);
+        cbounds.extend(centroids[ids[k]]);
+      }
+      nodes[n].bounds = bounds;
+      uint32_t mid;
+      if (!split(first, count, bounds, cbounds, boxes, centroids, mid)) {
+        continue;
+      }
+      uint32_t left = (uint32_t)nodes.size();
+      nodes.push_back(Node{TAABB(), first, mid - first});
+      nodes.push_back(Node{TAABB(), mid, first + count - mid});
+      nodes[n].first = left;
+      nodes[n].count = 0;
+      stack.push_back(left + 1);
+      stack.push_back(left);
+    }
+    triangles.reserve(src.size());
+    for (uint32_t id : ids) {
+      triangles.push_back(src[id]);
+    }
+  }
+
+  size_t size() const { return nodes.size(); }
+  size_t triangleCount() const { return triangles.size(); }
+
+  // Nearest intersection in [tmin, tmax]. id is the index of the triangle in
+  // the source array.
+  bool raycast(const RayT<T> &ray, T &t, uint32_t &id, T tmin = 0,
+               T tmax = std::numeric_limits<T>::infinity()) const {
+    if (nodes.empty()) {
+      return false;
+    }
+    struct Entry {
+      uint32_t node;
+      T distance;
+    };
+    TVector inv = {1 / ray.direction.x, 1 / ray.direction.y,
+                   1 / ray.direction.z};
+    bool hit = false;
+    T entry;
+    SmallVector<Entry, 64> stack;
+    if (nodes[0].bounds.intersects(ray, inv, tmin, tmax, entry)) {
+      stack.push_back({0, entry});
+    }
+    while (!stack.empty()) {
+      Entry e = stack.back();
+      stack.pop_back();
+      if (e.distance > tmax) {
+        continue;
+      }
+      const Node &node = nodes[e.node];
+      if (node.count > 0) {
+        for (uint32_t k = node.first; k < node.first + node.count; k++) {
+          T d;
+          if (triangles[k].raycast(ray, d) && d >= tmin && d <= tmax) {
+            tmax = d;
+            id = ids[k];
+            hit = true;
+          }
+        }
+        continue;
+      }
+      // visit the nearer child first.
+      const Node &left = nodes[node.first], &right = nodes[node.first + 1];
+      T dl, dr;
+      bool l = left.bounds.intersects(ray, inv, tmin, tmax, dl);
+      bool r = right.bounds.intersects(ray, inv, tmin, tmax, dr);
+      if (l && r && dl < dr) {
+        stack.push_back({node.first + 1, dr});
+        stack.push_back({node.first, dl});
+      } else {
+        if (l) stack.push_back({node.first, dl});
+        if (r) stack.push_back({node.first + 1, dr});
+      }
+    }
+    t = tmax;
+    return hit;
+  }
+
+  // Closest point on the triangles within maxDistance.
+  bool closestPoint(const TVector &p, TVector &result, uint32_t &id,
+                    T maxDistance = std::numeric_limits<T>::infinity()) const {
+    if (nodes.empty()) {
+      return false;
+    }
+    struct Entry {
+      uint32_t node;
+      T distanceSqr;
+    };
+    T best = maxDistance * maxDistance;
+    bool found = false;
+    SmallVector<Entry, 64> stack;
+    stack.push_back({0, nodes[0].bounds.distanceSqr(p)});
+    while (!stack.empty()) {
+      Entry e = stack.back();
+      stack.pop_back();
+      if (e.distanceSqr > best) {
+        continue;
+      }
+      const Node &node = nodes[e.node];
+      if (node.count > 0) {
+        for (uint32_t k = node.first; k < node.first + node.count; k++) {
+          TVector c = triangles[k].closestPoint(p);
+          T d = (c - p).lengthSqr();
+          if (d <= best) {
+            best = d;
+            result = c;
+            id = ids[k];
+            found = true;
+          }
+        }
+        continue;
+      }
+      T dl = nodes[node.first].bounds.distanceSqr(p);
+      T dr = nodes[node.first + 1].bounds.distanceSqr(p);
+      if (dl < dr) {
+        stack.push_back({node.first + 1, dr});
+        stack.push_back({node.first, dl});
+      } else {
+        stack.push_back({node.first, dl});
+        stack.push_back({node.first + 1, dr});
+      }
+    }
+    return found;
+  }
+
+  // Appends the source indices of the triangles intersecting tri.
+  void overlaps(const TTriangle &tri, std::vector<uint32_t> &result,
+                T eps = 0) const {
+    if (nodes.empty()) {
+      return;
+    }
+    TAABB box = tri.bounds();
+    SmallVector<uint32_t, 64> stack{0};
+    while (!stack.empty()) {
+      const Node &node = nodes[stack.back()];
+      stack.pop_back();
+      if (!node.bounds.intersects(box)) {
+        continue;
+      }
+      if (node.count == 0) {
+        stack.push_back(node.first);
+        stack.push_back(node.first + 1);
+        continue;
+      }
+      for (uint32_t k = node.first; k < node.first + node.count; k++) {
+        if (triangles[k].bounds().intersects(box) &&
+            triangles[k].intersects(tri, eps)) {
+          result.push_back(ids[k]);
+        }
+      }
+    }
+  }
+
+ private:
+  // Finds the best binned SAH split of ids[first, first + count) and
+  // partitions them. Returns false if the node should be a leaf.
+  bool split(uint32_t first, uint32_t count, const TAABB &bounds,
+             const TAABB &cbounds, const std::vector<TAABB> &boxes,
+             const std::vector<TVector> &centroids, uint32_t &mid) {
+    if (count <= 1) {
+      return false;
+    }
+    struct Bin {
+      TAABB bounds;
+      uint32_t count = 0;
+    };
+    T bestCost = std::numeric_limits<T>::infinity();
+    int bestAxis = -1, bestBin = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      T lo = component(cbounds.min, axis), hi = component(cbounds.max, axis);
+      if (!(hi > lo)) {
+        continue;
+      }
+      T scale = BINS / (hi - lo);
+      Bin bins[BINS];
+      for (uint32_t k = first; k < first + count; k++) {
+        int b = binIndex(centroids[ids[k]], axis, lo, scale);
+        bins[b].bounds.extend(boxes[ids[k]]);
+        bins[b].count++;
+      }
+      T leftArea[BINS - 1];
+      uint32_t leftCount[BINS - 1];
+      TAABB lb, rb;
+      uint32_t lc = 0, rc = 0;
+      for (int i = 0; i < BINS - 1; i++) {
+        lb.extend(bins[i].bounds);
+        lc += bins[i].count;
+        leftArea[i] = lb.halfArea();
+        leftCount[i] = lc;
+      }
+      for (int i = BINS - 1; i > 0; i--) {
+        rb.extend(bins[i].bounds);
+        rc += bins[i].count;
+        if (leftCount[i - 1] == 0 || rc == 0) {
+          continue;
+        }
+        T cost = leftArea[i - 1] * leftCount[i - 1] + rb.halfArea() * rc;
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = i;
+        }
+      }
+    }
+    if (bestAxis < 0) {
+      return false;  // all centroids are at the same position.
+    }
+    T area = bounds.halfArea();
+    if (count <= MAX_LEAF_SIZE &&
+        TRAVERSAL_COST * area + bestCost >= area * count) {
+      return false;
+    }
+    T lo = component(cbounds.min, bestAxis);
+    T scale = BINS / (component(cbounds.max, bestAxis) - lo);
+    auto it = std::partition(
+        ids.begin() + first, ids.begin() + first + count, [&](uint32_t id) {
+          return binIndex(centroids[id], bestAxis, lo, scale) < bestBin;
+        });
+    mid = (uint32_t)(it - ids.begin());
+    return true;
+  }
+
+  static int binIndex(const TVector &c, int axis, T lo, T scale) {
+    return std::min(BINS - 1, (int)((component(c, axis) - lo) * scale));
+  }
+};
+
+typedef AABBT<FloatType> AABB;
+typedef TriangleT<FloatType> Triangle;
+typedef BVHT<FloatType> BVH;
+
+}  // namespace geom
@@ -0,0 +1,99 @@
+#pragma once
+#include <vector>
+
+#include "bsptree.h"
+#include "parallel.h"
+
+namespace geom {
+
+// Boolean operations on closed polygon meshes using BSP trees.
+// Inspired by csg.js https://evanw.github.io/csg.js/
+
+// Removes the parts of polygons inside (or outside if `inner` is true) of the
+// tree. Polygons which are not clipped are kept as is, not fragmented. The
+// tree may have a lower precision than the polygons.
+template <typename TPlane, typename T, typename O>
+std::vector<Polygon<T, O>> clipPolygons(
+    const BSPNodeT<TPlane> &tree, const std::vector<Polygon<T, O>> &polygons,
+    bool inner, T eps = 0, unsigned int threads = 1) {
+  std::vector<std::vector<Polygon<T, O>>> clipped(polygons.size());
+  std::vector<char> unchanged(polygons.size());
+  parallel_for(
+      polygons.size(),
+      [&](size_t i) {
+        std::vector<Polygon<T, O>> in, out;
+        tree.splitPolygons(std::vector<Polygon<T, O>>{polygons[i]}, in, out,
+                           (typename TPlane::TElement)eps);
+        unchanged[i] = (inner ? out : in).empty();
+        if (!unchanged[i]) {
+          clipped[i] = std::move(inner ? in : out);
+        }
+      },
+      threads);
+
+  std::vector<Polygon<T, O>> result;
+  result.reserve(polygons.size());
+  for (size_t i = 0; i < polygons.size(); i++) {
+    if (unchanged[i]) {
+      result.push_back(polygons[i]);
+    } else {
+      result.insert(result.end(), clipped[i].begin(), clipped[i].end());
+    }
+  }
+  return result;
+}
+
+template <typename T, typename O>
+void flipPolygons(std::vector<Polygon<T, O>> &polygons) {
+  for (auto &p : polygons) {
+    p.flip();
+  }
+}
+
+template <typename T, typename O>
+std::vector<Polygon<T, O>> csgUnion(
+    const std::vector<Polygon<T, O>> &a, const std::vector<Polygon<T, O>> &b,
+    T eps = 0, const BSPBuildOptions &opts = BSPBuildOptions()) {
+  BSPNodeT<PlaneT<T>> ta(a, eps, opts), tb(b, eps, opts);
+  auto ap = clipPolygons(tb, a, false, eps, opts.threads);
+  auto bp = clipPolygons(ta, b, false, eps, opts.threads);
+  flipPolygons(bp);
+  bp = clipPolygons(ta, bp, false, eps, opts.threads);
+  flipPolygons(bp);
+  ap.insert(ap.end(), bp.begin(), bp.end());
+  return ap;
+}
+
+template <typename T, typename O>
+std::vector<Polygon<T, O>> csgSubtract(
+    const std::vector<Polygon<T, O>> &a, const std::vector<Polygon<T, O>> &b,
+    T eps = 0, const BSPBuildOptions &opts = BSPBuildOptions()) {
+  BSPNodeT<PlaneT<T>> ta(a, eps, opts), tb(b, eps, opts);
+  auto ap = a;
+  flipPolygons(ap);
+  ap = clipPolygons(tb, ap, false, eps, opts.threads);
+  auto bp = clipPolygons(ta, b, true, eps, opts.threads);
+  flipPolygons(ap);
+  flipPolygons(bp);
+  bp = clipPolygons(ta, bp, true, eps, opts.threads);
+  ap.insert(ap.end(), bp.begin(), bp.end());
+  return ap;
+}
+
+template <typename T, typename O>
+std::vector<Polygon<T, O>> csgIntersect(
+    const std::vector<Polygon<T, O>> &a, const std::vector<Polygon<T, O>> &b,
+    T eps = 0, const BSPBuildOptions &opts = BSPBuildOptions()) {
+  BSPNodeT<PlaneT<T>> ta(a, eps, opts), tb(b, eps, opts);
+  auto ap = a;
+  flipPolygons(ap);
+  auto bp = clipPolygons(ta, b, true, eps, opts.threads);
+  flipPolygons(bp);
+  ap = clipPolygons(tb, ap, true, eps, opts.threads);
+  bp = clipPolygons(ta, bp, true, eps, opts.threads);
+  ap.insert(ap.end(), bp.begin(), bp.end());
+  flipPolygons(ap);
+  return ap;
+}
+
+}  // namespace geom
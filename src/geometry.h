@@ -7,6 +7,8 @@
 #include <limits>
 #include <string>
 
+#include "predicates.h"
+
 namespace geom {
 
 template <typename T>
@@ -40,6 +42,10 @@ struct Vector3T {
   Vector3T<T> lerp(const Vector3T<T> &v, T t) const {
     return Vector3T<T>{*this + (v - *this) * t};
   }
+  template <typename U>
+  Vector3T<U> cast() const {
+    return Vector3T<U>{(U)x, (U)y, (U)z};
+  }
   std::string to_string() const { return std::format("({},{},{})", x, y, z); }
 };
 
@@ -148,14 +154,44 @@ struct PlaneT {
 
   PlaneT<T> flipped() const { return PlaneT<T>{-normal, -w}; }
 
+  template <typename U>
+  PlaneT<U> cast() const {
+    return PlaneT<U>(normal.template cast<U>(), (U)w);
+  }
+
+  // computed in double precision for float planes.
   static PlaneT<T> fromPoints(const Vector3T<T> &a, const Vector3T<T> &b,
                               const Vector3T<T> &c) {
-    auto n = (b - a).cross(c - a).normalized();
-    return PlaneT<T>(n, n.dot(a));
+    auto da = a.template cast<double>();
+    auto n = (b.template cast<double>() - da)
+                 .cross(c.template cast<double>() - da)
+                 .normalized();
+    return PlaneT<double>(n, n.dot(da)).template cast<T>();
+  }
+  // Newell's method, so the first points may be collinear and the polygon may
+  // be slightly non-planar. Returns an invalid plane if the polygon has no
+  // area.
+  static PlaneT<T> fromPolygon(const Vector3T<T> *v, size_t count) {
+    Vector3T<double> n{0, 0, 0}, c{0, 0, 0};
+    for (size_t i = 0; i < count; i++) {
+      auto a = v[i].template cast<double>();
+      auto b = v[(i + 1) % count].template cast<double>();
+      n = n + Vector3T<double>{(a.y - b.y) * (a.z + b.z),
+                               (a.z - b.z) * (a.x + b.x),
+                               (a.x - b.x) * (a.y + b.y)};
+      c = c + a;
+    }
+    double length = n.length();
+    if (!(length > 0) || !std::isfinite(length)) {
+      return PlaneT<T>();
+    }
+    n = n / length;
+    return PlaneT<double>(n, n.dot(c / (double)count)).template cast<T>();
   }
+  // exact for the plane coefficients. see predicates.h
   int classifyPoint(const Vector3T<T> &v, T eps = 0) const {
-    T t = signedDistanceTo(v);
-    return (t < -eps) ? BACK : (t > eps) ? FRONT : COPLANAR;
+    return predicates::classifyPoint(normal.x, normal.y, normal.z, w, v.x, v.y,
+                                     v.z, eps);
   }
   T distanceTo(const Vector3T<T> &v) const {
     return std::abs(signedDistanceTo(v));
@@ -165,8 +201,10 @@ struct PlaneT {
     return std::format("[{},{}]", normal.to_string(), w);
   }
   Vector3T<T> intersection(const Vector3T<T>& p1, const Vector3T<T>& p2) const {
-    T t = (w - normal.dot(p1)) / normal.dot(p2 - p1);
-    return p1.lerp(p2, t);
+    auto n = normal.template cast<double>();
+    auto d1 = p1.template cast<double>(), d2 = p2.template cast<double>();
+    double t = (w - n.dot(d1)) / n.dot(d2 - d1);
+    return d1.lerp(d2, t).template cast<T>();
   }
   bool isValid() const { return normal.lengthSqr() > 0; }
 };
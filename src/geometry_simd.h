@@ -0,0 +1,320 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "geometry.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || \
+    defined(__i386__)
+#define GEOM_SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX intrinsics in any function. GCC and Clang need the target
+// attribute.
+#if defined(__GNUC__) || defined(__clang__)
+#define GEOM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GEOM_TARGET_AVX2
+#endif
+
+// Batch versions of the Matrix4T/PlaneT/Vector3T operations with SSE2 and AVX2
+// implementations selected at runtime. FMA is not used and the operations are
+// done in the same order as geometry.h, so every level returns exactly the
+// same results as the scalar code.
+//
+// Points are either SoA (x[], y[], z[]) or interleaved [x0, y0, z0, x1, ...]
+// float/double arrays. Interleaved points are transposed in registers.
+// Output arrays may be the same as the input arrays.
+namespace geom::simd {
+
+enum class Level { SCALAR = 0, SSE2 = 1, AVX2 = 2 };
+
+inline Level detectLevel() {
+#if !defined(GEOM_SIMD_X86)
+  return Level::SCALAR;
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] >= 7) {
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (osxsave && avx && (_xgetbv(0) & 6) == 6) {
+      __cpuidex(info, 7, 0);
+      if (info[1] & (1 << 5)) {
+        return Level::AVX2;
+      }
+    }
+  }
+  return Level::SSE2;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? Level::AVX2 : Level::SSE2;
+#endif
+}
+
+// The level used by the batch functions.
+inline Level &activeLevel() {
+  static Level level = detectLevel();
+  return level;
+}
+
+// Lowers the level (e.g. for benchmarks). Levels the CPU does not support are
+// ignored.
+inline void setLevel(Level level) {
+  activeLevel() = std::min(level, detectLevel());
+}
+
+inline const char *levelName(Level level) {
+  return level == Level::AVX2   ? "avx2"
+         : level == Level::SSE2 ? "sse2"
+                                : "scalar";
+}
+
+namespace detail {
+
+#ifdef GEOM_SIMD_X86
+
+//---------------------------------------------------------------------------------------------------------------------
+// SSE2 (2 points)
+//---------------------------------------------------------------------------------------------------------------------
+
+struct SSE2 {
+  typedef __m128d V;
+  static constexpr size_t N = 2;
+
+  static V set1(double v) { return _mm_set1_pd(v); }
+  static V load(const double *p) { return _mm_loadu_pd(p); }
+  static V load(const float *p) {
+    return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)p)));
+  }
+  static void store(double *p, V v) { _mm_storeu_pd(p, v); }
+  static void store(float *p, V v) {
+    _mm_storel_epi64((__m128i *)p, _mm_castps_si128(_mm_cvtpd_ps(v)));
+  }
+  static V add(V a, V b) { return _mm_add_pd(a, b); }
+  static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+  static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+
+  // [x0 y0 z0 x1 y1 z1] <-> [x0 x1] [y0 y1] [z0 z1]
+  template <typename T>
+  static void loadPoints(const T *p, V &x, V &y, V &z) {
+    V v0 = load(p), v1 = load(p + 2), v2 = load(p + 4);
+    x = _mm_shuffle_pd(v0, v1, 2);
+    y = _mm_shuffle_pd(v0, v2, 1);
+    z = _mm_shuffle_pd(v1, v2, 2);
+  }
+  template <typename T>
+  static void storePoints(T *p, V x, V y, V z) {
+    store(p, _mm_shuffle_pd(x, y, 0));
+    store(p + 2, _mm_shuffle_pd(z, x, 2));
+    store(p + 4, _mm_shuffle_pd(y, z, 3));
+  }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// AVX2 (4 points)
+//---------------------------------------------------------------------------------------------------------------------
+
+struct AVX2 {
+  typedef __m256d V;
+  static constexpr size_t N = 4;
+
+  GEOM_TARGET_AVX2 static V set1(double v) { return _mm256_set1_pd(v); }
+  GEOM_TARGET_AVX2 static V load(const double *p) { return _mm256_loadu_pd(p); }
+  GEOM_TARGET_AVX2 static V load(const float *p) {
+    return _mm256_cvtps_pd(_mm_loadu_ps(p));
+  }
+  GEOM_TARGET_AVX2 static void store(double *p, V v) {
+    _mm256_storeu_pd(p, v);
+  }
+  GEOM_TARGET_AVX2 static void store(float *p, V v) {
+    _mm_storeu_ps(p, _mm256_cvtpd_ps(v));
+  }
+  GEOM_TARGET_AVX2 static V add(V a, V b) { return _mm256_add_pd(a, b); }
+  GEOM_TARGET_AVX2 static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+  GEOM_TARGET_AVX2 static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+
+  // [x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3] <-> [x0..x3] [y0..y3] [z0..z3]
+  template <typename T>
+  GEOM_TARGET_AVX2 static void loadPoints(const T *p, V &x, V &y, V &z) {
+    V v0 = load(p), v1 = load(p + 4), v2 = load(p + 8);
+    V u0 = _mm256_blend_pd(v0, v1, 0xc);           // x0 y0 x2 y2
+    V u1 = _mm256_permute2f128_pd(v0, v2, 0x21);  // z0 x1 z2 x3
+    V u2 = _mm256_blend_pd(v1, v2, 0xc);           // y1 z1 y3 z3
+    x = _mm256_blend_pd(u0, u1, 0xa);
+    y = _mm256_shuffle_pd(u0, u2, 0x5);
+    z = _mm256_blend_pd(u1, u2, 0xa);
+  }
+  template <typename T>
+  GEOM_TARGET_AVX2 static void storePoints(T *p, V x, V y, V z) {
+    V u0 = _mm256_shuffle_pd(x, y, 0x0);
+    V u1 = _mm256_shuffle_pd(z, x, 0xa);
+    V u2 = _mm256_shuffle_pd(y, z, 0xf);
+    store(p, _mm256_permute2f128_pd(u0, u1, 0x20));
+    store(p + 4, _mm256_permute2f128_pd(u2, u0, 0x30));
+    store(p + 8, _mm256_permute2f128_pd(u1, u2, 0x31));
+  }
+};
+
+#endif  // GEOM_SIMD_X86
+
+}  // namespace detail
+}  // namespace geom::simd
+
+// GCC only inlines the AVX2 intrinsics into functions with the same target,
+// but the SSE2 kernels must not be compiled with it or they would use VEX
+// encoded instructions. So the kernels are compiled once per level, into
+// detail::sse2 and detail::avx2.
+#ifdef GEOM_SIMD_X86
+#define GEOM_SIMD_NAMESPACE sse2
+#define GEOM_SIMD_TRAITS SSE2
+#define GEOM_SIMD_TARGET
+#include "geometry_simd_kernels.h"
+#undef GEOM_SIMD_NAMESPACE
+#undef GEOM_SIMD_TRAITS
+#undef GEOM_SIMD_TARGET
+
+#define GEOM_SIMD_NAMESPACE avx2
+#define GEOM_SIMD_TRAITS AVX2
+#define GEOM_SIMD_TARGET GEOM_TARGET_AVX2
+#include "geometry_simd_kernels.h"
+#undef GEOM_SIMD_NAMESPACE
+#undef GEOM_SIMD_TRAITS
+#undef GEOM_SIMD_TARGET
+#endif  // GEOM_SIMD_X86
+
+// Calls detail::{sse2,avx2}::kernel(args...) and returns the number of
+// processed elements.
+#ifdef GEOM_SIMD_X86
+#define GEOM_SIMD_DISPATCH(kernel, ...)                               \
+  (activeLevel() == Level::AVX2   ? detail::avx2::kernel(__VA_ARGS__) \
+   : activeLevel() == Level::SSE2 ? detail::sse2::kernel(__VA_ARGS__) \
+                                  : size_t(0))
+#else
+#define GEOM_SIMD_DISPATCH(kernel, ...) size_t(0)
+#endif
+
+namespace geom::simd {
+
+//---------------------------------------------------------------------------------------------------------------------
+// SoA
+//---------------------------------------------------------------------------------------------------------------------
+
+// o[i] = m.applyTo(v[i])
+inline void transform(const Matrix4T<double> &m, const double *x,
+                      const double *y, const double *z, double *ox, double *oy,
+                      double *oz, size_t n) {
+  size_t i = GEOM_SIMD_DISPATCH(transform, m, x, y, z, ox, oy, oz, n);
+  for (; i < n; i++) {
+    Vector3T<double> p = m.applyTo(Vector3T<double>{x[i], y[i], z[i]});
+    ox[i] = p.x;
+    oy[i] = p.y;
+    oz[i] = p.z;
+  }
+}
+
+// out[i] = plane.signedDistanceTo(v[i])
+inline void signedDistances(const PlaneT<double> &plane, const double *x,
+                            const double *y, const double *z, double *out,
+                            size_t n) {
+  size_t i = GEOM_SIMD_DISPATCH(signedDistances, plane, x, y, z, out, n);
+  for (; i < n; i++) {
+    out[i] = plane.signedDistanceTo(Vector3T<double>{x[i], y[i], z[i]});
+  }
+}
+
+// out[i] = a[i].dot(b[i])
+inline void dot(const double *ax, const double *ay, const double *az,
+                const double *bx, const double *by, const double *bz,
+                double *out, size_t n) {
+  size_t i = GEOM_SIMD_DISPATCH(dot, ax, ay, az, bx, by, bz, out, n);
+  for (; i < n; i++) {
+    out[i] = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i];
+  }
+}
+
+// o[i] = a[i].cross(b[i])
+inline void cross(const double *ax, const double *ay, const double *az,
+                  const double *bx, const double *by, const double *bz,
+                  double *ox, double *oy, double *oz, size_t n) {
+  size_t i =
+      GEOM_SIMD_DISPATCH(cross, ax, ay, az, bx, by, bz, ox, oy, oz, n);
+  for (; i < n; i++) {
+    Vector3T<double> c = Vector3T<double>{ax[i], ay[i], az[i]}.cross(
+        Vector3T<double>{bx[i], by[i], bz[i]});
+    ox[i] = c.x;
+    oy[i] = c.y;
+    oz[i] = c.z;
+  }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Interleaved (T: float or double)
+//---------------------------------------------------------------------------------------------------------------------
+
+template <typename T>
+void transformPoints(const Matrix4T<double> &m, const T *src, T *dst,
+                     size_t count) {
+  size_t i = GEOM_SIMD_DISPATCH(transformPoints, m, src, dst, count);
+  for (; i < count; i++) {
+    const T *s = src + i * 3;
+    Vector3T<double> p = m.applyTo(Vector3T<double>{s[0], s[1], s[2]});
+    dst[i * 3] = (T)p.x;
+    dst[i * 3 + 1] = (T)p.y;
+    dst[i * 3 + 2] = (T)p.z;
+  }
+}
+
+template <typename T>
+void signedDistances(const PlaneT<double> &plane, const T *src, double *out,
+                     size_t count) {
+  size_t i = GEOM_SIMD_DISPATCH(signedDistances, plane, src, out, count);
+  for (; i < count; i++) {
+    const T *s = src + i * 3;
+    out[i] = plane.signedDistanceTo(Vector3T<double>{s[0], s[1], s[2]});
+  }
+}
+
+// out[i] = plane.classifyPoint(v[i], eps). Points whose distance is too close
+// to the tolerance band for the fast result are passed to the exact predicate.
+template <typename T>
+void classifyPoints(const PlaneT<double> &plane, const T *src, uint8_t *out,
+                    size_t count, double eps = 0) {
+  constexpr size_t BLOCK_SIZE = 256;
+  double nmax = std::max({std::abs(plane.normal.x), std::abs(plane.normal.y),
+                          std::abs(plane.normal.z)});
+  double d[BLOCK_SIZE];
+  for (size_t b = 0; b < count; b += BLOCK_SIZE) {
+    size_t n = std::min(BLOCK_SIZE, count - b);
+    signedDistances(plane, src + b * 3, d, n);
+    for (size_t i = 0; i < n; i++) {
+      const T *s = src + (b + i) * 3;
+      double bound =
+          8 * DBL_EPSILON *
+              (nmax * (std::abs(s[0]) + std::abs(s[1]) + std::abs(s[2])) +
+               std::abs(plane.w)) +
+          2 * DBL_EPSILON * std::abs(eps);
+      if (!(std::abs(std::abs(d[i]) - eps) > bound)) {
+        out[b + i] =
+            plane.classifyPoint(Vector3T<double>{s[0], s[1], s[2]}, eps);
+      } else {
+        out[b + i] = (d[i] < -eps)  ? PlaneT<double>::BACK
+                     : (d[i] > eps) ? PlaneT<double>::FRONT
+                                    : PlaneT<double>::COPLANAR;
+      }
+    }
+  }
+}
+
+#undef GEOM_SIMD_DISPATCH
+
+}  // namespace geom::simd
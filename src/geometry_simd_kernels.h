@@ -0,0 +1,125 @@
+// Kernels of geometry_simd.h. This file has no include guard: it is included
+// once per level with these macros defined.
+//   GEOM_SIMD_NAMESPACE  namespace of the kernels (sse2, avx2)
+//   GEOM_SIMD_TRAITS     instruction set (SSE2, AVX2)
+//   GEOM_SIMD_TARGET     function attribute for the instruction set
+//
+// The kernels process S::N points per iteration and return the number of
+// points processed. The rest are handled by the scalar code.
+
+#define GEOM_SIMD_KERNEL GEOM_SIMD_TARGET inline
+
+namespace geom::simd::detail::GEOM_SIMD_NAMESPACE {
+
+typedef GEOM_SIMD_TRAITS S;
+typedef S::V V;
+
+GEOM_SIMD_KERNEL V dot3(V ax, V ay, V az, V bx, V by, V bz) {
+  return S::add(S::add(S::mul(ax, bx), S::mul(ay, by)), S::mul(az, bz));
+}
+
+struct TransformKernel {
+  V r[3][4], t[3];
+
+  GEOM_SIMD_TARGET explicit TransformKernel(const Matrix4T<double> &m) {
+    for (int row = 0; row < 3; row++) {
+      for (int col = 0; col < 4; col++) {
+        r[row][col] = S::set1(m[row * 4 + col]);
+      }
+      t[row] = S::set1(m[12 + row]);
+    }
+  }
+  // m[0] * x + m[1] * y + m[2] * z + m[3] + m[12]
+  GEOM_SIMD_TARGET V row(int i, V x, V y, V z) const {
+    V v = dot3(r[i][0], r[i][1], r[i][2], x, y, z);
+    return S::add(S::add(v, r[i][3]), t[i]);
+  }
+};
+
+GEOM_SIMD_KERNEL size_t transform(const Matrix4T<double> &m, const double *x,
+                                  const double *y, const double *z, double *ox,
+                                  double *oy, double *oz, size_t n) {
+  TransformKernel k(m);
+  size_t i = 0;
+  for (; i + S::N <= n; i += S::N) {
+    V vx = S::load(x + i), vy = S::load(y + i), vz = S::load(z + i);
+    S::store(ox + i, k.row(0, vx, vy, vz));
+    S::store(oy + i, k.row(1, vx, vy, vz));
+    S::store(oz + i, k.row(2, vx, vy, vz));
+  }
+  return i;
+}
+
+template <typename T>
+GEOM_SIMD_KERNEL size_t transformPoints(const Matrix4T<double> &m,
+                                        const T *src, T *dst, size_t count) {
+  TransformKernel k(m);
+  size_t i = 0;
+  for (; i + S::N <= count; i += S::N) {
+    V x, y, z;
+    S::loadPoints(src + i * 3, x, y, z);
+    S::storePoints(dst + i * 3, k.row(0, x, y, z), k.row(1, x, y, z),
+                   k.row(2, x, y, z));
+  }
+  return i;
+}
+
+GEOM_SIMD_KERNEL size_t signedDistances(const PlaneT<double> &plane,
+                                        const double *x, const double *y,
+                                        const double *z, double *out,
+                                        size_t n) {
+  V nx = S::set1(plane.normal.x), ny = S::set1(plane.normal.y),
+    nz = S::set1(plane.normal.z), w = S::set1(plane.w);
+  size_t i = 0;
+  for (; i + S::N <= n; i += S::N) {
+    V d = dot3(nx, ny, nz, S::load(x + i), S::load(y + i), S::load(z + i));
+    S::store(out + i, S::sub(d, w));
+  }
+  return i;
+}
+
+template <typename T>
+GEOM_SIMD_KERNEL size_t signedDistances(const PlaneT<double> &plane,
+                                        const T *src, double *out,
+                                        size_t count) {
+  V nx = S::set1(plane.normal.x), ny = S::set1(plane.normal.y),
+    nz = S::set1(plane.normal.z), w = S::set1(plane.w);
+  size_t i = 0;
+  for (; i + S::N <= count; i += S::N) {
+    V x, y, z;
+    S::loadPoints(src + i * 3, x, y, z);
+    S::store(out + i, S::sub(dot3(nx, ny, nz, x, y, z), w));
+  }
+  return i;
+}
+
+GEOM_SIMD_KERNEL size_t dot(const double *ax, const double *ay,
+                            const double *az, const double *bx,
+                            const double *by, const double *bz, double *out,
+                            size_t n) {
+  size_t i = 0;
+  for (; i + S::N <= n; i += S::N) {
+    S::store(out + i, dot3(S::load(ax + i), S::load(ay + i), S::load(az + i),
+                           S::load(bx + i), S::load(by + i), S::load(bz + i)));
+  }
+  return i;
+}
+
+GEOM_SIMD_KERNEL size_t cross(const double *ax, const double *ay,
+                              const double *az, const double *bx,
+                              const double *by, const double *bz, double *ox,
+                              double *oy, double *oz, size_t n) {
+  size_t i = 0;
+  for (; i + S::N <= n; i += S::N) {
+    V x1 = S::load(ax + i), y1 = S::load(ay + i), z1 = S::load(az + i);
+    V x2 = S::load(bx + i), y2 = S::load(by + i), z2 = S::load(bz + i);
+    S::store(ox + i, S::sub(S::mul(y1, z2), S::mul(z1, y2)));
+    S::store(oy + i, S::sub(S::mul(z1, x2), S::mul(x1, z2)));
+    S::store(oz + i, S::sub(S::mul(x1, y2), S::mul(y1, x2)));
+  }
+  return i;
+}
+
+}  // namespace geom::simd::detail::GEOM_SIMD_NAMESPACE
+
+#undef GEOM_SIMD_KERNEL
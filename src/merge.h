@@ -0,0 +1,363 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "geometry.h"
+#include "weld.h"
+
+namespace geom {
+
+//-----------------------------------------------------------------------------
+// Coplanar polygon merging
+//-----------------------------------------------------------------------------
+
+struct MergedPolygon {
+  std::vector<Vector3> vertices;
+  uint32_t source;  // index of an input polygon merged into this polygon.
+};
+
+namespace detail {
+
+inline uint64_t edgeKey(uint32_t u, uint32_t v) {
+  return ((uint64_t)u << 32) | v;
+}
+
+// v1 is on the line v0-v2. (same test as cleanEdge in csg.js)
+inline bool isCollinear(const Vector3 &v0, const Vector3 &v1,
+                        const Vector3 &v2) {
+  Vector3 v01 = v1 - v0, v02 = v2 - v0;
+  return v01.length() * v02.length() - std::abs(v01.dot(v02)) < 1e-10;
+}
+
+// Maps the edges of the polygons to the polygon.
+inline void mapEdges(const std::vector<std::vector<uint32_t>> &polygons,
+                     const std::vector<uint32_t> &members,
+                     std::unordered_map<uint64_t, uint32_t> &edges) {
+  edges.clear();
+  for (uint32_t p : members) {
+    const auto &vs = polygons[p];
+    for (size_t i = 0; i < vs.size(); i++) {
+      edges.emplace(edgeKey(vs[i], vs[(i + 1) % vs.size()]), p);
+    }
+  }
+}
+
+// Inserts the vertices lying on the edges which have no opposite edge, so that
+// fragments touching with T-junctions share whole edges. Returns true if any
+// polygon is changed.
+// Vertices are looked up in a 2D grid on the plane of the polygons.
+inline bool splitTJunctions(std::vector<std::vector<uint32_t>> &polygons,
+                            const std::vector<uint32_t> &members,
+                            const std::vector<Vector3> &positions,
+                            const std::unordered_map<uint64_t, uint32_t> &edges,
+                            double eps) {
+  struct OpenEdge {
+    uint32_t polygon, index;
+  };
+  std::vector<OpenEdge> open;
+  std::vector<uint32_t> candidates;
+  Vector3 normal;
+  double length = 0;
+  for (uint32_t p : members) {
+    const auto &vs = polygons[p];
+    for (size_t i = 0; i < vs.size(); i++) {
+      uint32_t u = vs[i], v = vs[(i + 1) % vs.size()];
+      const Vector3 &a = positions[u], &b = positions[v];
+      normal = normal + (a - b).cross(a + b) * 0.5;  // Newell's method
+      if (!edges.count(edgeKey(v, u))) {
+        open.push_back({p, (uint32_t)i});
+        candidates.push_back(u);
+        candidates.push_back(v);
+        length += (b - a).length();
+      }
+    }
+  }
+  if (open.size() < 2) {
+    return false;
+  }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+
+  // project to the plane of the largest component of the normal.
+  double nx = std::abs(normal.x), ny = std::abs(normal.y),
+         nz = std::abs(normal.z);
+  int drop = nx >= ny && nx >= nz ? 0 : ny >= nz ? 1 : 2;
+  int ax = drop == 0 ? 1 : 0, ay = drop == 2 ? 1 : 2;
+  auto coord = [&](uint32_t v, int a) {
+    const Vector3 &p = positions[v];
+    return a == 0 ? p.x : a == 1 ? p.y : p.z;
+  };
+  double cellSize = std::max(length / open.size(), eps * 4);
+  auto cellOf = [&](double c) { return (int64_t)std::floor(c / cellSize); };
+  auto cellKey = [](int64_t x, int64_t y) {
+    return (uint64_t)x * 0x9e3779b97f4a7c15ull ^ (uint64_t)y;
+  };
+  std::unordered_map<uint64_t, std::vector<uint32_t>> grid;
+  for (uint32_t v : candidates) {
+    grid[cellKey(cellOf(coord(v, ax)), cellOf(coord(v, ay)))].push_back(v);
+  }
+
+  // vertices to insert after each open edge, ordered along the edge.
+  std::unordered_map<uint64_t, std::vector<std::pair<double, uint32_t>>>
+      inserts;
+  double epsSqr = eps * eps;
+  for (const OpenEdge &e : open) {
+    const auto &vs = polygons[e.polygon];
+    uint32_t u = vs[e.index], v = vs[(e.index + 1) % vs.size()];
+    const Vector3 &a = positions[u], &b = positions[v];
+    Vector3 ab = b - a;
+    double lengthSqr = ab.lengthSqr();
+    if (lengthSqr <= epsSqr) {
+      continue;
+    }
+    std::vector<std::pair<double, uint32_t>> found;
+    int64_t x0 = cellOf(std::min(coord(u, ax), coord(v, ax)) - eps),
+            x1 = cellOf(std::max(coord(u, ax), coord(v, ax)) + eps),
+            y0 = cellOf(std::min(coord(u, ay), coord(v, ay)) - eps),
+            y1 = cellOf(std::max(coord(u, ay), coord(v, ay)) + eps);
+    auto test = [&](uint32_t m) {
+      Vector3 am = positions[m] - a;
+      double t = am.dot(ab) / lengthSqr;
+      if (m != u && m != v && t > 0 && t < 1 &&
+          (am - ab * t).lengthSqr() <= epsSqr && am.lengthSqr() > epsSqr &&
+          (positions[m] - b).lengthSqr() > epsSqr &&
+          std::find(vs.begin(), vs.end(), m) == vs.end()) {
+        found.emplace_back(t, m);
+      }
+    };
+    if ((double)(x1 - x0 + 1) * (y1 - y0 + 1) > candidates.size()) {
+      // long edge. testing all the vertices is cheaper.
+      for (uint32_t m : candidates) {
+        test(m);
+      }
+    } else {
+      for (int64_t x = x0; x <= x1; x++) {
+        for (int64_t y = y0; y <= y1; y++) {
+          auto cell = grid.find(cellKey(x, y));
+          if (cell != grid.end()) {
+            for (uint32_t m : cell->second) {
+              test(m);
+            }
+          }
+        }
+      }
+    }
+    if (!found.empty()) {
+      std::sort(found.begin(), found.end());
+      inserts[edgeKey(e.polygon, e.index)] = std::move(found);
+    }
+  }
+  if (inserts.empty()) {
+    return false;
+  }
+  for (uint32_t p : members) {
+    auto &vs = polygons[p];
+    std::vector<uint32_t> split;
+    for (uint32_t i = 0; i < vs.size(); i++) {
+      split.push_back(vs[i]);
+      auto it = inserts.find(edgeKey(p, i));
+      if (it != inserts.end()) {
+        for (const auto &m : it->second) {
+          if (split.back() != m.second) {
+            split.push_back(m.second);
+          }
+        }
+      }
+    }
+    vs = std::move(split);
+  }
+  return true;
+}
+
+}  // namespace detail
+
+// Merges the polygons of each group (e.g. fragments of a source face) which
+// share edges. Polygon i has the vertices [offsets[i], offsets[i + 1]) of
+// positions (offsets has count + 1 elements, validated by the caller), and
+// vertices within eps are identified.
+//
+// A group is covered by regions grown from a seed polygon. A neighbor is added
+// to a region only if it shares a single chain of edges with the region and
+// touches it nowhere else, so every region stays a disk bounded by one loop.
+// Edges are matched through a hash map, so the whole pass is linear in the
+// number of edges. Collinear vertices are removed from the merged polygons
+// like cleanEdge in csg.js, and polygons which are not merged are returned as
+// is.
+template <typename T>
+std::vector<MergedPolygon> mergeCoplanarPolygons(
+    const T *positions, size_t length, const uint32_t *offsets, size_t count,
+    const uint32_t *groups, double eps) {
+  const uint32_t NONE = UINT32_MAX;
+  std::vector<uint32_t> remap;
+  std::vector<T> welded = weldVertices(positions, length / 3, eps, remap);
+  std::vector<Vector3> points(welded.size() / 3);
+  for (size_t i = 0; i < points.size(); i++) {
+    points[i] = Vector3(welded[i * 3], welded[i * 3 + 1], welded[i * 3 + 2]);
+  }
+  auto original = [&](uint32_t p) {
+    std::vector<Vector3> vs;
+    for (uint32_t k = offsets[p]; k < offsets[p + 1]; k++) {
+      const T *v = positions + (size_t)k * 3;
+      vs.emplace_back(v[0], v[1], v[2]);
+    }
+    return vs;
+  };
+
+  // welded vertex indices without repeated vertices. polygons which are
+  // degenerate or pinched are not merged.
+  std::vector<std::vector<uint32_t>> polygons(count);
+  std::vector<char> mergeable(count);
+  std::unordered_map<uint32_t, std::vector<uint32_t>> members;
+  std::vector<uint32_t> groupOrder;
+  for (uint32_t p = 0; p < count; p++) {
+    auto &vs = polygons[p];
+    for (uint32_t k = offsets[p]; k < offsets[p + 1]; k++) {
+      if (vs.empty() || vs.back() != remap[k]) {
+        vs.push_back(remap[k]);
+      }
+    }
+    while (vs.size() > 1 && vs.front() == vs.back()) {
+      vs.pop_back();
+    }
+    std::vector<uint32_t> sorted = vs;
+    std::sort(sorted.begin(), sorted.end());
+    mergeable[p] = vs.size() >= 3 &&
+                   std::adjacent_find(sorted.begin(), sorted.end()) ==
+                       sorted.end();
+    if (mergeable[p]) {
+      auto &m = members[groups[p]];
+      if (m.empty()) {
+        groupOrder.push_back(groups[p]);
+      }
+      m.push_back(p);
+    }
+  }
+
+  std::vector<MergedPolygon> result;
+  std::vector<uint32_t> region(count, NONE), stamp(points.size(), NONE);
+  uint32_t regionCount = 0;
+  for (uint32_t p = 0; p < count; p++) {
+    if (!mergeable[p] && offsets[p + 1] - offsets[p] >= 3) {
+      result.push_back({original(p), p});
+    }
+  }
+  for (uint32_t g : groupOrder) {
+    const auto &group = members[g];
+    std::unordered_map<uint64_t, uint32_t> edges;
+    detail::mapEdges(polygons, group, edges);
+    if (detail::splitTJunctions(polygons, group, points, edges, eps)) {
+      detail::mapEdges(polygons, group, edges);
+    }
+    // owner of the opposite edge of the edge i of p.
+    auto twin = [&](const std::vector<uint32_t> &vs, size_t i) {
+      auto it = edges.find(detail::edgeKey(vs[(i + 1) % vs.size()], vs[i]));
+      return it == edges.end() ? NONE : it->second;
+    };
+
+    for (uint32_t seed : group) {
+      if (region[seed] != NONE) {
+        continue;
+      }
+      uint32_t r = regionCount++;
+      std::vector<uint32_t> added, queue;
+      auto add = [&](uint32_t p) {
+        region[p] = r;
+        added.push_back(p);
+        const auto &vs = polygons[p];
+        for (size_t i = 0; i < vs.size(); i++) {
+          stamp[vs[i]] = r;
+          uint32_t q = twin(vs, i);
+          if (q != NONE && region[q] == NONE) {
+            queue.push_back(q);
+          }
+        }
+      };
+      // p shares one chain of edges with the region and no other vertex.
+      auto canAdd = [&](uint32_t p) {
+        const auto &vs = polygons[p];
+        size_t n = vs.size(), starts = 0, shared = 0;
+        std::vector<char> onChain(n);
+        for (size_t i = 0; i < n; i++) {
+          uint32_t q = twin(vs, i);
+          if (q != NONE && region[q] == r) {
+            shared++;
+            onChain[i] = onChain[(i + 1) % n] = 1;
+            uint32_t prev = twin(vs, (i + n - 1) % n);
+            if (prev == NONE || region[prev] != r) {
+              starts++;
+            }
+          }
+        }
+        if (starts != 1 || shared == n) {
+          return false;
+        }
+        for (size_t i = 0; i < n; i++) {
+          if (!onChain[i] && stamp[vs[i]] == r) {
+            return false;
+          }
+        }
+        return true;
+      };
+      add(seed);
+      for (size_t i = 0; i < queue.size(); i++) {
+        uint32_t p = queue[i];
+        if (region[p] == NONE && canAdd(p)) {
+          add(p);
+        }
+      }
+      if (added.size() == 1) {
+        result.push_back({original(seed), seed});
+        continue;
+      }
+
+      // walk the boundary of the region.
+      std::unordered_map<uint32_t, uint32_t> next;
+      bool ok = true;
+      for (uint32_t p : added) {
+        const auto &vs = polygons[p];
+        for (size_t i = 0; i < vs.size(); i++) {
+          uint32_t q = twin(vs, i);
+          if (q == NONE || region[q] != r) {
+            ok &= next.emplace(vs[i], vs[(i + 1) % vs.size()]).second;
+          }
+        }
+      }
+      std::vector<Vector3> loop;
+      if (ok && !next.empty()) {
+        uint32_t start = next.begin()->first, v = start;
+        do {
+          loop.push_back(points[v]);
+          auto it = next.find(v);
+          v = it == next.end() ? start : it->second;
+        } while (v != start && loop.size() <= next.size());
+        ok = v == start && loop.size() == next.size();
+      }
+      for (bool update = ok; update;) {
+        update = false;
+        for (size_t k = 0; k < loop.size() && loop.size() >= 3; k++) {
+          size_t d = (k + 1) % loop.size();
+          if (detail::isCollinear(loop[k], loop[d],
+                                  loop[(k + 2) % loop.size()])) {
+            loop.erase(loop.begin() + d);
+            update = true;
+          }
+        }
+      }
+      if (ok && loop.size() >= 3) {
+        result.push_back({std::move(loop), seed});
+      } else {
+        for (uint32_t p : added) {
+          result.push_back({original(p), p});
+        }
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace geom
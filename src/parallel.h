@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use. 0 means all cores.
+inline unsigned int resolve_thread_count(unsigned int threads) {
+  return threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Worker threads shared by all parallel_for calls. The threads are started on
+// the first use and kept until shutdown() so that a call does not pay for
+// thread creation.
+class ThreadPool {
+ public:
+  static ThreadPool &instance() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  ~ThreadPool() { shutdown(); }
+
+  void post(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (workers.empty()) {
+        unsigned int n = std::max(1u, resolve_thread_count(0) - 1);
+        for (unsigned int i = 0; i < n; i++) {
+          workers.emplace_back([this]() { run(); });
+        }
+      }
+      jobs.push_back(std::move(job));
+    }
+    cond.notify_one();
+  }
+
+  // Stops and joins the threads. Must be called before the module is
+  // unloaded; joining threads in a static destructor of a DLL can deadlock.
+  void shutdown() {
+    std::vector<std::thread> stopping;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+      stopping.swap(workers);
+    }
+    cond.notify_all();
+    for (auto &t : stopping) {
+      t.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = false;
+  }
+
+ private:
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<std::function<void()>> jobs;
+  std::vector<std::thread> workers;
+  bool stop = false;
+
+  void run() {
+    for (;;) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this]() { return stop || !jobs.empty(); });
+        if (jobs.empty()) {
+          return;
+        }
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      job();
+    }
+  }
+};
+
+// Calls f(i) for each i in [0, count) using up to `threads` threads including
+// the calling thread. Indices are handed out one by one so that workers which
+// finish early pick up the remaining tasks. The first exception thrown by f is
+// rethrown on the calling thread after all the workers have stopped.
+//
+// The calling thread only waits for the pool jobs which have already started.
+// Jobs which start later find no indices left and return without touching f,
+// so nested calls can not deadlock even if every pool thread is busy.
+template <typename F>
+void parallel_for(size_t count, const F &f, unsigned int threads = 0) {
+  threads =
+      (unsigned int)std::min<size_t>(resolve_thread_count(threads), count);
+  if (threads <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      f(i);
+    }
+    return;
+  }
+  struct State {
+    std::atomic<size_t> next = 0;
+    std::atomic<unsigned int> active = 0;
+    size_t count;
+    const F *f;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+
+    void work() {
+      for (size_t i = next++; i < count; i = next++) {
+        try {
+          (*f)(i);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+          next = count;  // skip the remaining indices.
+        }
+      }
+    }
+  };
+  auto state = std::make_shared<State>();
+  state->count = count;
+  state->f = &f;
+  for (unsigned int i = 1; i < threads; i++) {
+    ThreadPool::instance().post([state]() {
+      state->active++;
+      state->work();
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (--state->active == 0) {
+        state->done.notify_all();
+      }
+    });
+  }
+  state->work();
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&]() { return state->active == 0; });
+  if (state->error) {
+    std::rethrow_exception(state->error);
+  }
+}
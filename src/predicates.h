@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+
+namespace geom::predicates {
+
+// Adaptive precision predicates in the manner of Shewchuk's "Adaptive
+// Precision Floating-Point Arithmetic and Fast Robust Geometric Predicates".
+// The expression is evaluated in double precision first and the exact value
+// is computed only if the error bound of the fast result can change the
+// answer. Inputs are double or float (float products are exact in double).
+
+// a + b = x + y exactly.
+inline void twoSum(double a, double b, double &x, double &y) {
+  x = a + b;
+  double bv = x - a;
+  double av = x - bv;
+  y = (a - av) + (b - bv);
+}
+
+// a * b = x + y exactly.
+inline void twoProduct(double a, double b, double &x, double &y) {
+  x = a * b;
+  y = std::fma(a, b, -x);
+}
+
+// Exact sign of the sum of the terms. The terms are accumulated into a
+// nonoverlapping expansion, whose sign is the sign of its largest component.
+template <size_t N>
+inline int signOfSum(const double (&terms)[N]) {
+  double e[N];
+  size_t len = 0;
+  for (double q : terms) {
+    size_t k = 0;
+    for (size_t i = 0; i < len; i++) {
+      double h;
+      twoSum(q, e[i], q, h);
+      if (h != 0) {
+        e[k++] = h;
+      }
+    }
+    if (q != 0) {
+      e[k++] = q;
+    }
+    len = k;
+  }
+  double top = len > 0 ? e[len - 1] : 0;
+  return (top > 0) - (top < 0);
+}
+
+// Exact sign of n.p - w - c.
+inline int planeSign(double nx, double ny, double nz, double w, double x,
+                     double y, double z, double c) {
+  double terms[8];
+  twoProduct(nx, x, terms[0], terms[1]);
+  twoProduct(ny, y, terms[2], terms[3]);
+  twoProduct(nz, z, terms[4], terms[5]);
+  terms[6] = -w;
+  terms[7] = -c;
+  return signOfSum(terms);
+}
+
+// Classifies p against the plane n.p = w with the tolerance eps, exactly for
+// the given coefficients. Returns 0 (coplanar), 1 (front) or 2 (back) like
+// PlaneT::classifyPoint.
+inline int classifyPoint(double nx, double ny, double nz, double w, double x,
+                         double y, double z, double eps) {
+  // 4 roundings in the distance, plus the roundings of the bound itself.
+  const double ERROR_BOUND = 4 * DBL_EPSILON;
+  double px = nx * x, py = ny * y, pz = nz * z;
+  double d = px + py + pz - w;
+  double bound = ERROR_BOUND * (std::abs(px) + std::abs(py) + std::abs(pz) +
+                                std::abs(w)) +
+                 DBL_EPSILON * std::abs(eps);
+  double a = std::abs(d);
+  if (a > eps + bound) {
+    return d < 0 ? 2 : 1;
+  }
+  if (a < eps - bound) {
+    return 0;
+  }
+  if (planeSign(nx, ny, nz, w, x, y, z, -eps) < 0) {
+    return 2;
+  }
+  return planeSign(nx, ny, nz, w, x, y, z, eps) > 0 ? 1 : 0;
+}
+
+}  // namespace geom::predicates
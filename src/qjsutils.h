@@ -30,17 +30,25 @@ static inline int64_t convert_jsvalue(JSContext* ctx, JSValue v) {
   JS_ToInt64(ctx, &ret, v);
   return ret;
 }
-template <>
-static inline double convert_jsvalue(JSContext* ctx, JSValue v) {
+// Unboxes numbers without calling JS_ToFloat64.
+static inline double to_float64(JSContext* ctx, JSValue v) {
+  int tag = JS_VALUE_GET_TAG(v);
+  if (tag == JS_TAG_INT) {
+    return JS_VALUE_GET_INT(v);
+  } else if (JS_TAG_IS_FLOAT64(tag)) {
+    return JS_VALUE_GET_FLOAT64(v);
+  }
   double ret = 0;
   JS_ToFloat64(ctx, &ret, v);
   return ret;
 }
 template <>
+static inline double convert_jsvalue(JSContext* ctx, JSValue v) {
+  return to_float64(ctx, v);
+}
+template <>
 static inline float convert_jsvalue(JSContext* ctx, JSValue v) {
-  double ret = 0;
-  JS_ToFloat64(ctx, &ret, v);
-  return (float)ret;
+  return (float)to_float64(ctx, v);
 }
 template <>
 static inline bool convert_jsvalue(JSContext* ctx, JSValue v) {
@@ -109,14 +117,6 @@ JSValue method_wrapper_getter(JSContext* ctx, JSValueConst this_val) {
   return invoke_function(method, ctx, this_val, 0, nullptr);
 }
 
-template <auto method>
-JSValue method_wrapper_append_data(JSContext* ctx, JSValueConst this_val,
-                                   int argc, JSValueConst* argv, int magic,
-                                   JSValue* func_data) {
-  argv[argc] = *func_data;  // TODO: check length of function.
-  return invoke_function(method, ctx, this_val, argc + 1, argv);
-}
-
 // function/method type.
 template <typename... Types>
 struct types {
@@ -243,47 +243,120 @@ constexpr JSCFunctionListEntry function_entry_getset(const char* name) {
   return function_entry_getset(name, method_wrapper_getter<getter>);
 }
 
-template <typename T, typename... Args>
-T get_class(JSValue (T::*method)(Args...)) {}
+template <typename T, typename R, typename... Args>
+T get_class(R (T::*method)(Args...)) {}
 
-template <auto getter>
-static int indexed_propery_getter(JSContext* ctx, JSPropertyDescriptor* desc,
-                                  JSValueConst obj, JSAtom prop) {
-  typedef decltype(get_class(getter)) T;
-  JSValue propv = JS_AtomToValue(ctx, prop);
-  // JS_AtomToValue and JS_ToIndex are too expensive...
+// Integer atoms (array indices) are tagged with the highest bit.
+// JS_AtomToValue and JS_ToIndex are too expensive...
+inline bool atom_to_index(JSAtom prop, uint32_t* index) {
   if ((prop & (1U << 31)) == 0) {
-    return 0;
+    return false;
   }
-  uint32_t index = (prop & ~(1U << 31));
-  desc->flags = 0;
-  desc->value =
-      std::invoke(getter, (T*)JS_GetOpaque2(ctx, obj, T::class_id), ctx, index);
-  return 1;
+  *index = prop & ~(1U << 31);
+  return true;
 }
 
-template <auto getter, auto setter>
+// Exotic methods of array-like classes. Index properties are read and written
+// through getter/setter without allocating accessor functions. Other
+// properties are resolved in the class prototype because get_property,
+// set_property and has_property bypass the prototype chain.
+template <auto getter, auto length>
 static int indexed_propery_handler(JSContext* ctx, JSPropertyDescriptor* desc,
                                    JSValueConst obj, JSAtom prop) {
   typedef decltype(get_class(getter)) T;
-  // JSValue propv = JS_AtomToValue(ctx, prop);
-  // JS_AtomToValue and JS_ToIndex are too expensive...
-  if ((prop & (1U << 31)) == 0) {
+  uint32_t index;
+  T* p = (T*)JS_GetOpaque(obj, T::class_id);
+  if (!p || !atom_to_index(prop, &index) ||
+      index >= (uint32_t)std::invoke(length, p)) {
     return 0;
   }
-  static JSValue indexValue = JS_UNDEFINED;  // TODO: multi-tread
   if (desc != nullptr) {
-    JS_FreeValue(ctx, indexValue);
-    indexValue = JS_NewInt32(ctx, (prop & ~(1U << 31)));
-    desc->flags = JS_PROP_GETSET;
-    desc->getter = JS_NewCFunctionData(ctx, method_wrapper_append_data<getter>,
-                                       1, 0, 1, &indexValue);
-    desc->setter = JS_NewCFunctionData(ctx, method_wrapper_append_data<setter>,
-                                       2, 0, 1, &indexValue);
+    desc->flags = JS_PROP_WRITABLE;
+    desc->value = std::invoke(getter, p, ctx, index);
+    desc->getter = JS_UNDEFINED;
+    desc->setter = JS_UNDEFINED;
   }
   return 1;
 }
 
+template <auto getter, auto length>
+static JSValue indexed_property_getter(JSContext* ctx, JSValueConst obj,
+                                       JSAtom prop, JSValueConst receiver) {
+  typedef decltype(get_class(getter)) T;
+  uint32_t index;
+  if (atom_to_index(prop, &index)) {
+    T* p = (T*)JS_GetOpaque(obj, T::class_id);
+    if (!p || index >= (uint32_t)std::invoke(length, p)) {
+      return JS_UNDEFINED;
+    }
+    return std::invoke(getter, p, ctx, index);
+  }
+  JSValue proto = JS_GetClassProto(ctx, T::class_id);
+  JSValue ret = JS_GetPropertyInternal(ctx, proto, prop, receiver, 0);
+  JS_FreeValue(ctx, proto);
+  return ret;
+}
+
+template <auto setter, auto length>
+static int indexed_property_setter(JSContext* ctx, JSValueConst obj,
+                                   JSAtom prop, JSValueConst value,
+                                   JSValueConst receiver, int flags) {
+  typedef decltype(get_class(setter)) T;
+  uint32_t index;
+  if (atom_to_index(prop, &index)) {
+    T* p = (T*)JS_GetOpaque(obj, T::class_id);
+    if (!p || index >= (uint32_t)std::invoke(length, p)) {
+      if (flags & (JS_PROP_THROW | JS_PROP_THROW_STRICT)) {
+        JS_ThrowRangeError(ctx, "index out of range");
+        return -1;
+      }
+      return 0;
+    }
+    std::invoke(setter, p, ctx, value, index);
+    return JS_HasException(ctx) ? -1 : 1;
+  }
+  // accessors and read-only properties may be anywhere in the prototype
+  // chain. a new property is defined on the receiver.
+  JSValue proto = JS_GetClassProto(ctx, T::class_id);
+  int ret = JS_SetPropertyInternal(ctx, proto, prop, JS_DupValue(ctx, value),
+                                   receiver, flags);
+  JS_FreeValue(ctx, proto);
+  return ret;
+}
+
+template <auto length>
+static int indexed_property_has(JSContext* ctx, JSValueConst obj,
+                                JSAtom prop) {
+  typedef decltype(get_class(length)) T;
+  uint32_t index;
+  if (atom_to_index(prop, &index)) {
+    T* p = (T*)JS_GetOpaque(obj, T::class_id);
+    return p && index < (uint32_t)std::invoke(length, p);
+  }
+  // has_property is called before looking up own properties.
+  int ret = JS_GetOwnProperty(ctx, nullptr, obj, prop);
+  if (ret != 0) {
+    return ret;
+  }
+  JSValue proto = JS_GetClassProto(ctx, T::class_id);
+  ret = JS_HasProperty(ctx, proto, prop);
+  JS_FreeValue(ctx, proto);
+  return ret;
+}
+
+template <auto getter, auto setter, auto length>
+constexpr JSClassExoticMethods indexed_exotic_methods(
+    int (*delete_property)(JSContext* ctx, JSValueConst obj,
+                           JSAtom prop) = nullptr) {
+  return JSClassExoticMethods{
+      .get_own_property = indexed_propery_handler<getter, length>,
+      .delete_property = delete_property,
+      .has_property = indexed_property_has<length>,
+      .get_property = indexed_property_getter<getter, length>,
+      .set_property = indexed_property_setter<setter, length>,
+  };
+}
+
 template <typename, typename = std::void_t<>>
 struct has_init : std::false_type {};
 template <typename T>
@@ -319,7 +392,12 @@ static JSValue simple_constructor(JSContext* ctx, JSValueConst new_target,
   JS_SetOpaque(obj, p);
 
   if constexpr (has_init<T>::value) {
-    invoke_function(&T::Init, ctx, obj, argc, argv);
+    JSValue ret = invoke_function(&T::Init, ctx, obj, argc, argv);
+    if (JS_IsException(ret)) {
+      JS_FreeValue(ctx, obj);
+      return JS_EXCEPTION;
+    }
+    JS_FreeValue(ctx, ret);
   }
 
   return obj;
@@ -333,6 +411,65 @@ void simple_finalizer(JSRuntime* rt, JSValue val) {
   }
 }
 
+// Property names accessed in hot paths of the bindings.
+#define HOT_ATOM_LIST(X)                                                      \
+  X(x) X(y) X(z) X(w) X(u) X(v) X(length) X(normal) X(plane) X(vertices)     \
+  X(src) X(id) X(refs) X(points) X(material) X(origin) X(direction)          \
+  X(position) X(distance) X(face) X(Uint8Array) X(Int32Array) X(Uint32Array)  \
+  X(Float32Array) X(Float64Array)
+
+// Distinct from uint32_t (JSAtom) so that ValueHolder can tell names from
+// indices.
+struct PropertyAtom {
+  JSAtom atom;
+};
+
+struct AtomTable {
+#define HOT_ATOM_MEMBER(name) PropertyAtom name;
+  HOT_ATOM_LIST(HOT_ATOM_MEMBER)
+#undef HOT_ATOM_MEMBER
+};
+
+// Returns the atoms of the runtime. They are interned on first use and live
+// until FreeAtomTable().
+inline const AtomTable& atoms(JSContext* ctx) {
+  JSRuntime* rt = JS_GetRuntime(ctx);
+  AtomTable* table = (AtomTable*)JS_GetRuntimeOpaque(rt);
+  if (table == nullptr) {
+    table = new AtomTable();
+#define HOT_ATOM_NEW(name) table->name.atom = JS_NewAtom(ctx, #name);
+    HOT_ATOM_LIST(HOT_ATOM_NEW)
+#undef HOT_ATOM_NEW
+    JS_SetRuntimeOpaque(rt, table);
+  }
+  return *table;
+}
+
+// Must be called before JS_FreeRuntime().
+inline void FreeAtomTable(JSRuntime* rt) {
+  AtomTable* table = (AtomTable*)JS_GetRuntimeOpaque(rt);
+  if (table == nullptr) {
+    return;
+  }
+#define HOT_ATOM_FREE(name) JS_FreeAtomRT(rt, table->name.atom);
+  HOT_ATOM_LIST(HOT_ATOM_FREE)
+#undef HOT_ATOM_FREE
+  delete table;
+  JS_SetRuntimeOpaque(rt, nullptr);
+}
+
+// Reads v.x, v.y and v.z. Fields which are not numbers are converted with
+// JS_ToFloat64 (NaN if missing).
+static inline void get_xyz(JSContext* ctx, JSValueConst v, double* xyz) {
+  const AtomTable& a = atoms(ctx);
+  const JSAtom names[] = {a.x.atom, a.y.atom, a.z.atom};
+  for (int i = 0; i < 3; i++) {
+    JSValue c = JS_GetProperty(ctx, v, names[i]);
+    xyz[i] = to_float64(ctx, c);
+    JS_FreeValue(ctx, c);
+  }
+}
+
 class ValueHolder {
   JSValue value;
   friend JSValue unwrap(ValueHolder&& v);
@@ -371,7 +508,7 @@ class ValueHolder {
   bool IsUndefined() { return JS_IsUndefined(value); }
   bool IsException() { return JS_IsException(value); }
   bool IsFunction() { return JS_IsFunction(ctx, value); }
-  uint32_t Length() { return (*this)["length"].To<uint32_t>(); }
+  uint32_t Length() { return (*this)[atoms(ctx).length].To<uint32_t>(); }
   template <typename T>
   T To() {
     return convert_jsvalue<T>(ctx, value);
@@ -382,6 +519,9 @@ class ValueHolder {
   ValueHolder operator[](const char* name) {
     return ValueHolder(ctx, JS_GetPropertyStr(ctx, value, name));
   }
+  ValueHolder operator[](PropertyAtom name) {
+    return ValueHolder(ctx, JS_GetProperty(ctx, value, name.atom));
+  }
   template <typename TN>
   void SetFree(TN name, JSValue v) {
     JSAtom prop = to_atom(name);
@@ -434,6 +574,7 @@ class ValueHolder {
   JSAtom to_atom(const std::string& v) { return JS_NewAtom(ctx, v.c_str()); }
   JSAtom to_atom(const char* v) { return JS_NewAtom(ctx, v); }
   JSAtom to_atom(uint32_t v) { return JS_NewAtomUInt32(ctx, v); }
+  JSAtom to_atom(PropertyAtom v) { return JS_DupAtom(ctx, v.atom); }
 };
 
 inline JSValue unwrap(ValueHolder&& v) {
@@ -442,6 +583,78 @@ inline JSValue unwrap(ValueHolder&& v) {
   return value;
 }
 
+// Typed arrays.
+template <typename T>
+struct typed_array_traits;
+template <>
+struct typed_array_traits<uint8_t> {
+  static constexpr const char* name = "Uint8Array";
+  static PropertyAtom atom(JSContext* ctx) { return atoms(ctx).Uint8Array; }
+};
+template <>
+struct typed_array_traits<int32_t> {
+  static constexpr const char* name = "Int32Array";
+  static PropertyAtom atom(JSContext* ctx) { return atoms(ctx).Int32Array; }
+};
+template <>
+struct typed_array_traits<uint32_t> {
+  static constexpr const char* name = "Uint32Array";
+  static PropertyAtom atom(JSContext* ctx) { return atoms(ctx).Uint32Array; }
+};
+template <>
+struct typed_array_traits<float> {
+  static constexpr const char* name = "Float32Array";
+  static PropertyAtom atom(JSContext* ctx) { return atoms(ctx).Float32Array; }
+};
+template <>
+struct typed_array_traits<double> {
+  static constexpr const char* name = "Float64Array";
+  static PropertyAtom atom(JSContext* ctx) { return atoms(ctx).Float64Array; }
+};
+
+// Returns the elements of v if it is a typed array of T, otherwise nullptr.
+// The pointer is valid while v is alive and its buffer is not detached.
+template <typename T>
+inline T* GetTypedArrayData(JSContext* ctx, JSValueConst v, size_t* length) {
+  if (!JS_IsObject(v)) {
+    return nullptr;
+  }
+  ValueHolder global(ctx, JS_GetGlobalObject(ctx));
+  ValueHolder ctor = global[typed_array_traits<T>::atom(ctx)];
+  if (JS_IsInstanceOf(ctx, v, ctor.GetValueNoDup()) != 1) {
+    return nullptr;
+  }
+  size_t offset, bytes, bytes_per_element;
+  JSValue buf =
+      JS_GetTypedArrayBuffer(ctx, v, &offset, &bytes, &bytes_per_element);
+  if (JS_IsException(buf)) {
+    return nullptr;
+  }
+  size_t size;
+  uint8_t* data = JS_GetArrayBuffer(ctx, &size, buf);
+  JS_FreeValue(ctx, buf);
+  if (!data) {
+    return nullptr;
+  }
+  *length = bytes / sizeof(T);
+  return (T*)(data + offset);
+}
+
+// Returns a new typed array of T holding a copy of data.
+template <typename T>
+inline JSValue NewTypedArray(JSContext* ctx, const T* data, size_t length) {
+  JSValue buf =
+      JS_NewArrayBufferCopy(ctx, (const uint8_t*)data, length * sizeof(T));
+  if (JS_IsException(buf)) {
+    return buf;
+  }
+  ValueHolder global(ctx, JS_GetGlobalObject(ctx));
+  ValueHolder ctor = global[typed_array_traits<T>::atom(ctx)];
+  JSValue arr = JS_CallConstructor(ctx, ctor.GetValueNoDup(), 1, &buf);
+  JS_FreeValue(ctx, buf);
+  return arr;
+}
+
 template <typename T>
 class JSClassBase {
  public:
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+namespace geom {
+
+// Vector that keeps up to N elements inline and falls back to the heap when
+// it grows beyond that. Only for trivially copyable types.
+template <typename T, size_t N>
+class SmallVector {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  T *heap = nullptr;
+  size_t count = 0;
+  size_t cap = N;
+  T buf[N];
+
+ public:
+  SmallVector() {}
+  explicit SmallVector(size_t n) { resize(n); }
+  template <typename It>
+  SmallVector(It first, It last) {
+    reserve(std::distance(first, last));
+    for (; first != last; ++first) {
+      buf_ptr()[count++] = *first;
+    }
+  }
+  SmallVector(std::initializer_list<T> v) : SmallVector(v.begin(), v.end()) {}
+  SmallVector(const std::vector<T> &v) : SmallVector(v.begin(), v.end()) {}
+  SmallVector(const SmallVector &v) : SmallVector(v.begin(), v.end()) {}
+  SmallVector(SmallVector &&v) noexcept { take(v); }
+  ~SmallVector() { delete[] heap; }
+
+  SmallVector &operator=(const SmallVector &v) {
+    if (this != &v) {
+      clear();
+      reserve(v.count);
+      std::copy(v.begin(), v.end(), buf_ptr());
+      count = v.count;
+    }
+    return *this;
+  }
+  SmallVector &operator=(SmallVector &&v) noexcept {
+    if (this != &v) {
+      delete[] heap;
+      heap = nullptr;
+      cap = N;
+      take(v);
+    }
+    return *this;
+  }
+
+  T *data() { return buf_ptr(); }
+  const T *data() const { return buf_ptr(); }
+  size_t size() const { return count; }
+  size_t capacity() const { return cap; }
+  bool empty() const { return count == 0; }
+  T &operator[](size_t i) { return buf_ptr()[i]; }
+  const T &operator[](size_t i) const { return buf_ptr()[i]; }
+  T &front() { return buf_ptr()[0]; }
+  const T &front() const { return buf_ptr()[0]; }
+  T &back() { return buf_ptr()[count - 1]; }
+  const T &back() const { return buf_ptr()[count - 1]; }
+  T *begin() { return buf_ptr(); }
+  T *end() { return buf_ptr() + count; }
+  const T *begin() const { return buf_ptr(); }
+  const T *end() const { return buf_ptr() + count; }
+
+  void push_back(const T &v) {
+    if (count == cap) {
+      T tmp = v;  // v may point into this vector.
+      reserve(cap * 2);
+      buf_ptr()[count++] = tmp;
+    } else {
+      buf_ptr()[count++] = v;
+    }
+  }
+  void pop_back() { count--; }
+  void clear() { count = 0; }
+  void resize(size_t n) {
+    reserve(n);
+    count = n;
+  }
+  void reserve(size_t n) {
+    if (n <= cap) {
+      return;
+    }
+    T *p = new T[n];
+    std::copy(begin(), end(), p);
+    delete[] heap;
+    heap = p;
+    cap = n;
+  }
+
+ private:
+  T *buf_ptr() { return heap ? heap : buf; }
+  const T *buf_ptr() const { return heap ? heap : buf; }
+  void take(SmallVector &v) {
+    if (v.heap) {
+      heap = v.heap;
+      cap = v.cap;
+      v.heap = nullptr;
+      v.cap = N;
+    } else {
+      std::copy(v.buf, v.buf + v.count, buf);
+    }
+    count = v.count;
+    v.count = 0;
+  }
+};
+
+}  // namespace geom
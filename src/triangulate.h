@@ -0,0 +1,80 @@
+#pragma once
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "geometry.h"
+
+namespace geom {
+
+// Triangulates a polygon by ear clipping. Writes (count - 2) * 3 indices of
+// points to triangles. The polygon is projected on its plane, so concave and
+// slightly non-planar polygons are supported. If no ear is found (e.g. the
+// polygon intersects itself), the most convex vertex is clipped.
+template <typename T>
+void triangulatePolygon(const Vector3T<T> *points, int count, int *triangles) {
+  // 2D coordinates on the plane, counterclockwise.
+  std::vector<Vector3T<double>> p(count);
+  for (int i = 0; i < count; i++) {
+    p[i] = points[i].template cast<double>();
+  }
+  Vector3T<double> n = PlaneT<double>::fromPolygon(p.data(), count).normal;
+  double ax = std::abs(n.x), ay = std::abs(n.y), az = std::abs(n.z);
+  std::vector<double> u(count), v(count);
+  for (int i = 0; i < count; i++) {
+    if (ax >= ay && ax >= az) {
+      u[i] = p[i].y, v[i] = n.x < 0 ? -p[i].z : p[i].z;
+    } else if (ay >= az) {
+      u[i] = p[i].z, v[i] = n.y < 0 ? -p[i].x : p[i].x;
+    } else {
+      u[i] = p[i].x, v[i] = n.z < 0 ? -p[i].y : p[i].y;
+    }
+  }
+  auto area2 = [&](int a, int b, int c) {
+    return (u[b] - u[a]) * (v[c] - v[a]) - (v[b] - v[a]) * (u[c] - u[a]);
+  };
+  auto same = [&](int a, int b) { return u[a] == u[b] && v[a] == v[b]; };
+
+  std::vector<int> ring(count);
+  std::iota(ring.begin(), ring.end(), 0);
+  while (ring.size() > 3) {
+    size_t m = ring.size(), ear = m, convex = 0;
+    double convexArea = -INFINITY;
+    for (size_t i = 0; i < m && ear == m; i++) {
+      int a = ring[(i + m - 1) % m], b = ring[i], c = ring[(i + 1) % m];
+      double area = area2(a, b, c);
+      if (area > convexArea) {
+        convexArea = area, convex = i;
+      }
+      if (area <= 0) {
+        continue;  // reflex or collinear.
+      }
+      bool empty = true;
+      for (size_t k = 0; k < m && empty; k++) {
+        int q = ring[k];
+        if (q == a || q == b || q == c || same(q, a) || same(q, b) ||
+            same(q, c)) {
+          continue;
+        }
+        empty = area2(a, b, q) < 0 || area2(b, c, q) < 0 || area2(c, a, q) < 0;
+      }
+      if (empty) {
+        ear = i;
+      }
+    }
+    if (ear == m) {
+      ear = convex;
+    }
+    *triangles++ = ring[(ear + m - 1) % m];
+    *triangles++ = ring[ear];
+    *triangles++ = ring[(ear + 1) % m];
+    ring.erase(ring.begin() + ear);
+  }
+  if (ring.size() == 3) {
+    *triangles++ = ring[0];
+    *triangles++ = ring[1];
+    *triangles++ = ring[2];
+  }
+}
+
+}  // namespace geom
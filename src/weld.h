@@ -0,0 +1,137 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace geom {
+
+// Merges each vertex into the first vertex within eps (exact duplicates only
+// if eps is 0). remap[i] is the index of the welded vertex of the vertex i.
+// Returns the welded positions [x0, y0, z0, x1, ...].
+//
+// Space is divided into a uniform grid of 4 * eps cells. Each welded vertex is
+// registered in every cell its eps ball overlaps (usually 1, at most 8), so a
+// vertex only looks up its own cell and the whole pass is O(n).
+template <typename T>
+std::vector<T> weldVertices(const T *positions, size_t count, double eps,
+                            std::vector<uint32_t> &remap) {
+  const uint32_t NONE = UINT32_MAX;
+  struct Cell {
+    int64_t x, y, z;
+    bool operator==(const Cell &c) const {
+      return x == c.x && y == c.y && z == c.z;
+    }
+  };
+  struct Slot {
+    Cell cell;
+    uint32_t entry = UINT32_MAX;  // first entry. NONE if the slot is empty.
+  };
+  struct Entry {
+    uint32_t vertex;
+    uint32_t next;  // next entry in the same cell.
+  };
+
+  // open addressing hash table of the cells. kept at most half full.
+  std::vector<Slot> slots(16);
+  size_t used = 0;
+  auto find = [](std::vector<Slot> &slots, const Cell &c) -> Slot & {
+    uint64_t h = (uint64_t)c.x * 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 29) ^ (uint64_t)c.y) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 32) ^ (uint64_t)c.z) * 0x94d049bb133111ebull;
+    size_t mask = slots.size() - 1;
+    for (size_t i = (h ^ (h >> 31)) & mask;; i = (i + 1) & mask) {
+      if (slots[i].entry == UINT32_MAX || slots[i].cell == c) {
+        return slots[i];
+      }
+    }
+  };
+  auto reserve = [&](size_t cells) {
+    if (cells * 2 <= slots.size()) {
+      return;
+    }
+    size_t capacity = slots.size();
+    while (capacity < cells * 2) {
+      capacity *= 2;
+    }
+    std::vector<Slot> old = std::exchange(slots, std::vector<Slot>(capacity));
+    for (const Slot &s : old) {
+      if (s.entry != NONE) {
+        find(slots, s.cell) = s;
+      }
+    }
+  };
+  reserve(count);
+
+  std::vector<T> welded;
+  std::vector<Entry> entries;
+  welded.reserve(count * 3);
+  entries.reserve(count);
+  remap.resize(count);
+
+  bool grid = eps > 0;
+  double scale = grid ? 0.25 / eps : 0, epsSqr = eps * eps;
+  for (size_t i = 0; i < count; i++) {
+    const T *p = positions + i * 3;
+    double v[3] = {(double)p[0], (double)p[1], (double)p[2]};
+    if (!std::isfinite(v[0]) || !std::isfinite(v[1]) || !std::isfinite(v[2])) {
+      remap[i] = (uint32_t)(welded.size() / 3);
+      welded.insert(welded.end(), p, p + 3);
+      continue;
+    }
+    // the cell of v, and the neighbor cell on each axis if the eps ball
+    // reaches it.
+    int64_t cell[3], side[3];
+    for (int a = 0; a < 3; a++) {
+      if (grid) {
+        // shifted by half a cell so that round coordinates are not on the
+        // cell boundaries. the eps ball (0.25 cells) is widened by a margin
+        // for the rounding of f, otherwise vertices exactly eps apart may be
+        // in cells that do not know each other.
+        double f = v[a] * scale + 0.5, c = std::floor(f);
+        double r = 0.25 + (1 + std::abs(f)) * 1e-12;
+        cell[a] = (int64_t)c;
+        side[a] = f - c < r ? -1 : f - c > 1 - r ? 1 : 0;
+      } else {
+        double z = v[a] + 0.0;  // -0.0 == 0.0
+        std::memcpy(&cell[a], &z, sizeof(z));
+        side[a] = 0;
+      }
+    }
+
+    uint32_t found = NONE;
+    for (uint32_t e = find(slots, Cell{cell[0], cell[1], cell[2]}).entry;
+         e != NONE; e = entries[e].next) {
+      uint32_t w = entries[e].vertex;
+      const T *q = welded.data() + (size_t)w * 3;
+      double dx = v[0] - q[0], dy = v[1] - q[1], dz = v[2] - q[2];
+      if (w < found && dx * dx + dy * dy + dz * dz <= epsSqr) {
+        found = w;
+      }
+    }
+    if (found == NONE) {
+      found = (uint32_t)(welded.size() / 3);
+      welded.insert(welded.end(), p, p + 3);
+      reserve(used + 8);
+      for (int k = 0; k < 8; k++) {
+        if ((k & 1 && !side[0]) || (k & 2 && !side[1]) || (k & 4 && !side[2])) {
+          continue;
+        }
+        Cell c{cell[0] + (k & 1 ? side[0] : 0), cell[1] + (k & 2 ? side[1] : 0),
+               cell[2] + (k & 4 ? side[2] : 0)};
+        Slot &slot = find(slots, c);
+        if (slot.entry == NONE) {
+          slot.cell = c;
+          used++;
+        }
+        entries.push_back({found, slot.entry});
+        slot.entry = (uint32_t)entries.size() - 1;
+      }
+    }
+    remap[i] = found;
+  }
+  return welded;
+}
+
+}  // namespace geom